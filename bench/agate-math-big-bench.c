@@ -0,0 +1,266 @@
+/*
+ * Native benchmark of the math/big kernels
+ *
+ * The kernels are static, so the implementation is included directly. Each
+ * operation is repeated on random operands until the measure lasts long
+ * enough, and the results are printed as a table on the standard output and,
+ * if requested, as CSV in a file.
+ *
+ * Usage: agate-math-big-bench [-n max_size] [-t min_time_ms] [-j workers] [-o output.csv]
+ */
+
+#include "agate-math-big.c"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_MAX_SIZE 65536
+#define BENCH_DEFAULT_MIN_TIME 0.1
+
+typedef enum {
+  BENCH_ADD,
+  BENCH_SUB,
+  BENCH_MUL,
+  BENCH_SQR,
+  BENCH_DIV,
+  BENCH_TO_CHARS,
+  BENCH_FROM_CHARS,
+} BenchOperation;
+
+static const char *benchOperationNames[] = {
+  "add",
+  "sub",
+  "mul",
+  "sqr",
+  "div",
+  "to_chars",
+  "from_chars",
+};
+
+typedef struct {
+  AgateVM *vm;
+  OnyxInteger lhs; // size digits, lhs >= rhs
+  OnyxInteger rhs; // size digits
+  OnyxInteger num; // 2 * size digits
+  OnyxInteger res;
+  OnyxInteger rem;
+  OnyxRadix radix;
+  char *str;
+  ptrdiff_t str_size;
+} BenchContext;
+
+/*
+ * Random operands
+ */
+
+static uint64_t benchRandomState = UINT64_C(0x9E3779B97F4A7C15);
+
+static uint64_t benchRandom(void) {
+  // xorshift64*
+  benchRandomState ^= benchRandomState >> 12;
+  benchRandomState ^= benchRandomState << 25;
+  benchRandomState ^= benchRandomState >> 27;
+  return benchRandomState * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static void benchRandomNatural(OnyxInteger *self, ptrdiff_t size, AgateVM *vm) {
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    self->digits[i] = (OnyxDigit) benchRandom();
+  }
+
+  // the operand has exactly size digits
+  self->digits[size - 1] |= (OnyxDigit) 1 << (ONYX_DIGIT_BITS - 1);
+  self->size = size;
+  self->positive = true;
+}
+
+/*
+ * Timing
+ */
+
+static double benchNow(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static void benchRun(BenchContext *context, BenchOperation operation) {
+  AgateVM *vm = context->vm;
+
+  switch (operation) {
+    case BENCH_ADD:
+      onyxNaturalAdd(&context->res, &context->lhs, &context->rhs, vm);
+      break;
+    case BENCH_SUB:
+      onyxNaturalSub(&context->res, &context->lhs, &context->rhs, vm);
+      break;
+    case BENCH_MUL:
+      onyxNaturalMul(&context->res, &context->lhs, &context->rhs, vm);
+      break;
+    case BENCH_SQR:
+      onyxNaturalMul(&context->res, &context->lhs, &context->lhs, vm);
+      break;
+    case BENCH_DIV:
+      onyxNaturalDiv(&context->res, &context->rem, &context->num, &context->rhs, vm);
+      break;
+    case BENCH_TO_CHARS:
+      onyxNaturalToChars(&context->lhs, context->str, context->str_size, &context->radix, vm);
+      break;
+    case BENCH_FROM_CHARS:
+      onyxNaturalFromChars(&context->res, context->str, context->str_size, &context->radix, vm);
+      break;
+  }
+}
+
+// returns the time of one operation, in seconds
+static double benchMeasure(BenchContext *context, BenchOperation operation, double min_time) {
+  benchRun(context, operation); // warm up the caches and the scratch arena
+
+  long iterations = 1;
+
+  for (;;) {
+    double start = benchNow();
+
+    for (long i = 0; i < iterations; ++i) {
+      benchRun(context, operation);
+    }
+
+    double elapsed = benchNow() - start;
+
+    if (elapsed >= min_time) {
+      return elapsed / (double) iterations;
+    }
+
+    // aim a bit further than the minimum time to avoid another round
+    if (elapsed <= 0.0) {
+      iterations *= 16;
+    } else {
+      double factor = 1.5 * min_time / elapsed;
+      iterations = factor > 16.0 ? iterations * 16 : (long) (iterations * factor) + 1;
+    }
+  }
+}
+
+/*
+ * Main
+ */
+
+static void benchUsage(const char *program) {
+  fprintf(stderr, "Usage: %s [-n max_size] [-t min_time_ms] [-j workers] [-o output.csv]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+  ptrdiff_t max_size = BENCH_DEFAULT_MAX_SIZE;
+  double min_time = BENCH_DEFAULT_MIN_TIME;
+  ptrdiff_t workers = 0;
+  const char *output_path = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      max_size = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      min_time = strtod(argv[++i], NULL) * 1e-3;
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      workers = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output_path = argv[++i];
+    } else {
+      benchUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (max_size < 1 || min_time <= 0.0 || workers < 0) {
+    benchUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *output = NULL;
+
+  if (output_path != NULL) {
+    output = fopen(output_path, "w");
+
+    if (output == NULL) {
+      fprintf(stderr, "Could not open '%s'\n", output_path);
+      return EXIT_FAILURE;
+    }
+
+    fprintf(output, "operation,digit_bits,workers,size,ns_per_op,digits_per_second\n");
+  }
+
+  onyxDigitsSelectKernels();
+  onyxWorkersSetCount(workers);
+
+  AgateConfig config;
+  agateConfigInitialize(&config);
+  AgateVM *vm = agateNewVM(&config);
+
+  // the state is registered by hand so that the kernels use the scratch arena
+  AgateMathBigState state;
+  state.vm = vm;
+  state.integer_class = NULL;
+  state.rational_class = NULL;
+  state.count = 0;
+  onyxScratchCreate(&state.scratch);
+  state.next = agateMathBigStates;
+  agateMathBigStates = &state;
+
+  BenchContext context;
+  context.vm = vm;
+  onyxIntegerCreateEmpty(&context.lhs);
+  onyxIntegerCreateEmpty(&context.rhs);
+  onyxIntegerCreateEmpty(&context.num);
+  onyxIntegerCreateEmpty(&context.res);
+  onyxIntegerCreateEmpty(&context.rem);
+  onyxRadixCreate(&context.radix, 10);
+
+  printf("digit bits: %d, workers: %td\n\n", ONYX_DIGIT_BITS, workers);
+  printf("%-12s %10s %16s %16s\n", "operation", "size", "ns/op", "digits/s");
+
+  for (ptrdiff_t size = 1; size <= max_size; size *= 2) {
+    benchRandomNatural(&context.lhs, size, vm);
+    benchRandomNatural(&context.rhs, size, vm);
+    benchRandomNatural(&context.num, 2 * size, vm);
+    context.rhs.digits[size - 1] >>= 1; // lhs >= rhs for the subtraction
+
+    // + 1 for the most significant character, + 1 for rounding errors
+    context.str_size = (ptrdiff_t) floor(size * ONYX_DIGIT_BITS * AGATE_LN2 / log(10)) + 2;
+    context.str = agateMemoryAllocate(vm, NULL, context.str_size);
+    onyxNaturalToChars(&context.lhs, context.str, context.str_size, &context.radix, vm);
+
+    for (BenchOperation operation = BENCH_ADD; operation <= BENCH_FROM_CHARS; ++operation) {
+      double seconds = benchMeasure(&context, operation, min_time);
+      double digits_per_second = (double) size / seconds;
+
+      printf("%-12s %10td %16.1f %16.4g\n", benchOperationNames[operation], size, seconds * 1e9, digits_per_second);
+
+      if (output != NULL) {
+        fprintf(output, "%s,%d,%td,%td,%.1f,%.6g\n", benchOperationNames[operation], ONYX_DIGIT_BITS, workers, size, seconds * 1e9, digits_per_second);
+      }
+    }
+
+    context.str = agateMemoryAllocate(vm, context.str, 0);
+    fflush(stdout);
+  }
+
+  onyxRadixDestroy(&context.radix, vm);
+  onyxIntegerDestroy(&context.rem, vm);
+  onyxIntegerDestroy(&context.res, vm);
+  onyxIntegerDestroy(&context.num, vm);
+  onyxIntegerDestroy(&context.rhs, vm);
+  onyxIntegerDestroy(&context.lhs, vm);
+
+  agateMathBigStates = state.next;
+  onyxScratchDestroy(&state.scratch, vm);
+
+  agateDeleteVM(vm);
+  onyxWorkersSetCount(0);
+
+  if (output != NULL) {
+    fclose(output);
+  }
+
+  return EXIT_SUCCESS;
+}
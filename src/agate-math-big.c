@@ -3,888 +3,7165 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "agate-tags.h"
 
-static const uint64_t BASE = UINT64_C(0x100000000);
+/*
+ * Digits are 64 bits wide when the compiler provides a 128-bit type for the
+ * intermediate results, and 32 bits wide otherwise.
+ */
+
+#if defined(__SIZEOF_INT128__) && !defined(ONYX_DIGIT_32)
+typedef uint64_t OnyxDigit;
+typedef unsigned __int128 OnyxDoubleDigit;
+#define ONYX_DIGIT_BITS 64
+#define ONYX_DIGIT_MAX UINT64_MAX
+#else
+typedef uint32_t OnyxDigit;
+typedef uint64_t OnyxDoubleDigit;
+#define ONYX_DIGIT_BITS 32
+#define ONYX_DIGIT_MAX UINT32_MAX
+#endif
+
+static const OnyxDoubleDigit BASE = (OnyxDoubleDigit) 1 << ONYX_DIGIT_BITS;
+
+#define ONYX_INT64_DIGITS (64 / ONYX_DIGIT_BITS)
+
+/*
+ * On x86-64 with 64-bit digits, the carry chains use inline assembly, unless
+ * ONYX_NO_ASM is defined
+ */
+
+#if ONYX_DIGIT_BITS == 64 && defined(__x86_64__) && defined(__GNUC__) && !defined(ONYX_NO_ASM)
+#define ONYX_X86_64_ASM 1
+#include <cpuid.h>
+#else
+#define ONYX_X86_64_ASM 0
+#endif
+
+/*
+ * The worker pool is available with POSIX threads, unless ONYX_NO_WORKERS is
+ * defined. It is empty until a count is set, so the default stays serial.
+ */
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(ONYX_NO_WORKERS)
+#define ONYX_WORKERS 1
+#include <pthread.h>
+#else
+#define ONYX_WORKERS 0
+#endif
+
+#ifndef ONYX_WORKERS_MAX
+#define ONYX_WORKERS_MAX 64
+#endif
+
+// in digits of the smallest operand of a product, or of the number to convert
+#ifndef ONYX_WORKERS_THRESHOLD
+#define ONYX_WORKERS_THRESHOLD 2048
+#endif
+
+/*
+ * Multiplication thresholds, in digits of the smallest operand
+ */
+
+#ifndef ONYX_MUL_KARATSUBA_THRESHOLD
+#if ONYX_DIGIT_BITS == 64
+#define ONYX_MUL_KARATSUBA_THRESHOLD 24
+#else
+#define ONYX_MUL_KARATSUBA_THRESHOLD 32
+#endif
+#endif
+
+#ifndef ONYX_MUL_TOOM3_THRESHOLD
+#if ONYX_DIGIT_BITS == 64
+#define ONYX_MUL_TOOM3_THRESHOLD 96
+#else
+#define ONYX_MUL_TOOM3_THRESHOLD 128
+#endif
+#endif
+
+#ifndef ONYX_MUL_NTT_THRESHOLD
+#if ONYX_DIGIT_BITS == 64
+#define ONYX_MUL_NTT_THRESHOLD 32768
+#else
+#define ONYX_MUL_NTT_THRESHOLD 12288
+#endif
+#endif
+
+// squaring, the basic squaring is faster than the basic multiplication so it stays longer
+#ifndef ONYX_SQR_KARATSUBA_THRESHOLD
+#if ONYX_DIGIT_BITS == 64
+#define ONYX_SQR_KARATSUBA_THRESHOLD 48
+#else
+#define ONYX_SQR_KARATSUBA_THRESHOLD 64
+#endif
+#endif
+
+#if ONYX_SQR_KARATSUBA_THRESHOLD < ONYX_MUL_KARATSUBA_THRESHOLD
+#error "ONYX_SQR_KARATSUBA_THRESHOLD must not be less than ONYX_MUL_KARATSUBA_THRESHOLD"
+#endif
+
+/*
+ * Division threshold, in digits of the divisor and of the quotient
+ */
+
+#ifndef ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD
+#if ONYX_DIGIT_BITS == 64
+#define ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD 48
+#else
+#define ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD 64
+#endif
+#endif
+
+#if ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD < 4
+#error "ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD must be at least 4"
+#endif
+
+/*
+ * Radix conversion threshold, in digits of the number
+ */
+
+#ifndef ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD
+#define ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD 64
+#endif
+
+#if ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD < 4
+#error "ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD must be at least 4"
+#endif
+
+/*
+ * Rational reduction threshold, in digits of the numerator and the denominator
+ */
+
+#ifndef ONYX_RATIONAL_REDUCE_THRESHOLD
+#define ONYX_RATIONAL_REDUCE_THRESHOLD 8
+#endif
+
+/*
+ * Binomial threshold, in ratio of n to k: when k <= n / ratio, the falling
+ * product divided by k! is cheaper than the factorization of n!, which needs a
+ * sieve up to n
+ */
+
+#ifndef ONYX_BINOMIAL_FALLING_RATIO
+#define ONYX_BINOMIAL_FALLING_RATIO 256
+#endif
+
+#if ONYX_BINOMIAL_FALLING_RATIO < 1
+#error "ONYX_BINOMIAL_FALLING_RATIO must be at least 1"
+#endif
+
+/*
+ * Small values are stored inline, the digits are allocated only when the
+ * value does not fit anymore
+ */
+
+#ifndef ONYX_INTEGER_SMALL_SIZE
+#define ONYX_INTEGER_SMALL_SIZE (128 / ONYX_DIGIT_BITS)
+#endif
 
 typedef struct {
-  uint32_t *digits;
+  OnyxDigit *digits; // small or allocated
   ptrdiff_t size;
   ptrdiff_t capacity;
   bool positive;
+  OnyxDigit small[ONYX_INTEGER_SMALL_SIZE];
 } OnyxInteger;
 
 /*
  * Algorithms - Basics
  */
 
+// the workers have no VM, they allocate with the C library
+static void *onyxMemoryAllocate(AgateVM *vm, void *ptr, ptrdiff_t size) {
+  if (vm != NULL) {
+    return agateMemoryAllocate(vm, ptr, size);
+  }
+
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  return realloc(ptr, size);
+}
+
 static void onyxIntegerCreateEmpty(OnyxInteger *self) {
-  self->digits = NULL;
-  self->size = self->capacity = 0;
+  self->digits = self->small;
+  self->size = 0;
+  self->capacity = ONYX_INTEGER_SMALL_SIZE;
   self->positive = true;
 }
 
 static void onyxIntegerDestroy(OnyxInteger *self, AgateVM *vm) {
-  if (self->digits != NULL) {
-    self->digits = agateMemoryAllocate(vm, self->digits, 0);
+  if (self->digits != self->small) {
+    self->digits = onyxMemoryAllocate(vm, self->digits, 0);
     assert(self->digits == NULL);
   }
 
-  self->size = self->capacity = 0;
-  self->positive = true;
+  onyxIntegerCreateEmpty(self);
+}
+
+// self takes the digits of other, other is left empty
+static void onyxIntegerMove(OnyxInteger *self, OnyxInteger *other, AgateVM *vm) {
+  assert(self != other);
+  onyxIntegerDestroy(self, vm);
+
+  if (other->digits == other->small) {
+    memcpy(self->small, other->small, sizeof(self->small));
+  } else {
+    self->digits = other->digits;
+    self->capacity = other->capacity;
+  }
+
+  self->size = other->size;
+  self->positive = other->positive;
+  onyxIntegerCreateEmpty(other);
 }
 
 static inline ptrdiff_t onyxSizeMax(ptrdiff_t lhs, ptrdiff_t rhs) {
   return lhs < rhs ? rhs : lhs;
 }
 
-
 /*
- * Algorithms - Natural
+ * Algorithms - Statistics
+ *
+ * When enabled, the main operations record their calls, the size of their
+ * largest operand and their duration, the dispatches record the algorithm
+ * they choose, and the digits record their allocations. The counters are
+ * shared by all the VMs and updated atomically. An operation called by
+ * another one is not recorded, only the outermost one, but the algorithms
+ * chosen by both are. When disabled, the cost is a relaxed load and a branch.
+ * The statistics are not compiled if ONYX_NO_STATS is defined.
  */
 
-static void onyxNaturalEnsureCapacity(OnyxInteger *self, ptrdiff_t capacity, AgateVM *vm) {
-  assert(capacity > 0);
-
-  if (self->capacity >= capacity) {
-    return;
-  }
+#if !defined(ONYX_NO_STATS)
+#define ONYX_STATS 1
+#include <time.h>
+#else
+#define ONYX_STATS 0
+#endif
+
+// sizes of the operands, in digits, by power of two, the last one gathers the larger sizes
+#define ONYX_STATS_SIZES 32
+
+typedef enum {
+  ONYX_STATS_ADD,
+  ONYX_STATS_SUB,
+  ONYX_STATS_MUL,
+  ONYX_STATS_SQR,
+  ONYX_STATS_DIV,
+  ONYX_STATS_POW,
+  ONYX_STATS_MODPOW,
+  ONYX_STATS_GCD,
+  ONYX_STATS_ROOT,
+  ONYX_STATS_TO_CHARS,
+  ONYX_STATS_FROM_CHARS,
+  ONYX_STATS_OPERATION_COUNT,
+} OnyxStatsOperation;
+
+typedef enum {
+  ONYX_STATS_MUL_BASIC,
+  ONYX_STATS_SQR_BASIC,
+  ONYX_STATS_MUL_KARATSUBA,
+  ONYX_STATS_MUL_TOOM3,
+  ONYX_STATS_MUL_NTT,
+  ONYX_STATS_MUL_UNBALANCED,
+  ONYX_STATS_DIV_BASIC,
+  ONYX_STATS_DIV_BURNIKEL_ZIEGLER,
+  ONYX_STATS_RADIX_BITS,
+  ONYX_STATS_RADIX_BASIC,
+  ONYX_STATS_RADIX_DIVIDE_AND_CONQUER,
+  ONYX_STATS_TIER_COUNT,
+} OnyxStatsTier;
+
+typedef enum {
+  ONYX_STATS_ALLOCATIONS, // first allocation of the digits of an integer
+  ONYX_STATS_REGROWTHS, // reallocation of the digits of an integer
+  ONYX_STATS_ALLOCATED_BYTES, // by the allocations and the regrowths
+  ONYX_STATS_SCRATCH_BYTES, // by the blocks of the scratch arenas
+  ONYX_STATS_MEMORY_COUNT,
+} OnyxStatsMemory;
 
-  if (self->capacity > 1) {
-    while (self->capacity < capacity) {
-      self->capacity += self->capacity / 2;
-    }
-  } else {
-    self->capacity = capacity;
-  }
+typedef struct {
+  atomic_uint_least64_t calls;
+  atomic_uint_least64_t nanoseconds;
+  atomic_uint_least64_t sizes[ONYX_STATS_SIZES];
+} OnyxStatsCounters;
 
-  assert(self->capacity >= capacity);
-  self->digits = agateMemoryAllocate(vm, self->digits, self->capacity * sizeof(uint32_t));
+typedef struct {
+  OnyxStatsCounters operations[ONYX_STATS_OPERATION_COUNT];
+  atomic_uint_least64_t tiers[ONYX_STATS_TIER_COUNT];
+  atomic_uint_least64_t memory[ONYX_STATS_MEMORY_COUNT];
+} OnyxStats;
+
+#if ONYX_STATS
+static const char *onyxStatsOperationNames[] = {
+  "add",
+  "sub",
+  "mul",
+  "sqr",
+  "div",
+  "pow",
+  "modpow",
+  "gcd",
+  "root",
+  "to_chars",
+  "from_chars",
+};
+
+static const char *onyxStatsTierNames[] = {
+  "mul_basic",
+  "sqr_basic",
+  "mul_karatsuba",
+  "mul_toom3",
+  "mul_ntt",
+  "mul_unbalanced",
+  "div_basic",
+  "div_burnikel_ziegler",
+  "radix_bits",
+  "radix_basic",
+  "radix_divide_and_conquer",
+};
+
+static const char *onyxStatsMemoryNames[] = {
+  "allocations",
+  "regrowths",
+  "allocated_bytes",
+  "scratch_bytes",
+};
+
+static OnyxStats onyxStats;
+static atomic_bool onyxStatsEnabled = false;
+// number of recorded operations in progress in the thread
+static _Thread_local ptrdiff_t onyxStatsDepth = 0;
+#endif
+
+// start of an operation nested in another one
+#define ONYX_STATS_NESTED UINT64_MAX
+
+static inline bool onyxStatsActive(void) {
+#if ONYX_STATS
+  return atomic_load_explicit(&onyxStatsEnabled, memory_order_relaxed);
+#else
+  return false;
+#endif
 }
 
-static void onyxNaturalCopy(OnyxInteger *self, const OnyxInteger *other, AgateVM *vm) {
-  onyxNaturalEnsureCapacity(self, other->size, vm);
-  self->size = other->size;
-  memcpy(self->digits, other->digits, other->size * sizeof(uint32_t));
+#if ONYX_STATS
+static uint64_t onyxStatsNow(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (uint64_t) now.tv_sec * UINT64_C(1000000000) + (uint64_t) now.tv_nsec;
 }
 
-static inline uint32_t onyxNaturalGet(const OnyxInteger *self, ptrdiff_t i) {
-  return (i < self->size) ? self->digits[i] : UINT32_C(0);
+static inline void onyxStatsAdd(atomic_uint_least64_t *counter, uint64_t value) {
+  atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
 }
+#endif
 
-static void onyxNaturalNormalize(OnyxInteger *self) {
-  while (self->size > 1 && self->digits[self->size - 1] == UINT32_C(0)) {
-    --self->size;
+// returns the start of an operation, 0 if the statistics are disabled, it must be given to onyxStatsLeave
+static inline uint64_t onyxStatsEnter(void) {
+#if ONYX_STATS
+  if (onyxStatsActive()) {
+    return onyxStatsDepth++ == 0 ? onyxStatsNow() : ONYX_STATS_NESTED;
   }
+#endif
+
+  return 0;
 }
 
-static int onyxNaturalCmp(const OnyxInteger *lhs, const OnyxInteger *rhs) {
-  assert(lhs->size > 0);
-  assert(rhs->size > 0);
+static inline void onyxStatsLeave(uint64_t start, OnyxStatsOperation operation, ptrdiff_t size) {
+#if ONYX_STATS
+  if (start == 0) {
+    return;
+  }
 
-  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
+  --onyxStatsDepth;
 
-  for (ptrdiff_t i = 0; i < size; ++i) {
-    uint32_t l = onyxNaturalGet(lhs, size - i - 1);
-    uint32_t r = onyxNaturalGet(rhs, size - i - 1);
+  if (start == ONYX_STATS_NESTED) {
+    return;
+  }
 
-    if (l > r) {
-      return 1;
-    }
-    if (l < r) {
-      return -1;
-    }
+  ptrdiff_t bucket = 0;
+
+  while (bucket + 1 < ONYX_STATS_SIZES && (size >> (bucket + 1)) != 0) {
+    ++bucket;
   }
 
-  return 0;
+  OnyxStatsCounters *counters = &onyxStats.operations[operation];
+  onyxStatsAdd(&counters->calls, 1);
+  onyxStatsAdd(&counters->nanoseconds, onyxStatsNow() - start);
+  onyxStatsAdd(&counters->sizes[bucket], 1);
+#else
+  (void) start;
+  (void) operation;
+  (void) size;
+#endif
 }
 
-static int onyxNaturalCmpZero(const OnyxInteger *self) {
-  for (ptrdiff_t i = 0; i < self->size; ++i) {
-    if (self->digits[i] != UINT32_C(0)) {
-      return 1;
-    }
+static inline void onyxStatsTier(OnyxStatsTier tier) {
+#if ONYX_STATS
+  if (onyxStatsActive()) {
+    onyxStatsAdd(&onyxStats.tiers[tier], 1);
   }
-
-  return 0;
+#else
+  (void) tier;
+#endif
 }
 
-static void onyxNaturalAdd(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  assert(lhs->size > 0);
-  assert(rhs->size > 0);
+static inline void onyxStatsMemory(OnyxStatsMemory memory, uint64_t value) {
+#if ONYX_STATS
+  if (onyxStatsActive()) {
+    onyxStatsAdd(&onyxStats.memory[memory], value);
+  }
+#else
+  (void) memory;
+  (void) value;
+#endif
+}
 
-  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
-  onyxNaturalEnsureCapacity(self, size + 1, vm);
+static void onyxStatsSetEnabled(bool enabled) {
+#if ONYX_STATS
+  atomic_store(&onyxStatsEnabled, enabled);
+#else
+  (void) enabled;
+#endif
+}
 
-  uint64_t carry = 0;
+static void onyxStatsReset(void) {
+#if ONYX_STATS
+  for (ptrdiff_t i = 0; i < ONYX_STATS_OPERATION_COUNT; ++i) {
+    OnyxStatsCounters *counters = &onyxStats.operations[i];
+    atomic_store_explicit(&counters->calls, 0, memory_order_relaxed);
+    atomic_store_explicit(&counters->nanoseconds, 0, memory_order_relaxed);
 
-  for (ptrdiff_t i = 0; i < size; ++i) {
-    uint64_t l = onyxNaturalGet(lhs, i);
-    uint64_t r = onyxNaturalGet(rhs, i);
-    uint64_t sum = carry + l + r;
-    self->digits[i] = sum;
-    carry = (sum >> 32);
-    assert(carry == 0 || carry == 1);
+    for (ptrdiff_t j = 0; j < ONYX_STATS_SIZES; ++j) {
+      atomic_store_explicit(&counters->sizes[j], 0, memory_order_relaxed);
+    }
   }
 
-  self->size = size;
+  for (ptrdiff_t i = 0; i < ONYX_STATS_TIER_COUNT; ++i) {
+    atomic_store_explicit(&onyxStats.tiers[i], 0, memory_order_relaxed);
+  }
 
-  if (carry == 1) {
-    self->digits[self->size++] = carry;
+  for (ptrdiff_t i = 0; i < ONYX_STATS_MEMORY_COUNT; ++i) {
+    atomic_store_explicit(&onyxStats.memory[i], 0, memory_order_relaxed);
   }
+#endif
 }
 
-static void onyxNaturalAddShort(OnyxInteger *self, const OnyxInteger *lhs, uint32_t rhs, AgateVM *vm) {
-  OnyxInteger fake;
-  fake.digits = &rhs;
-  fake.size = fake.capacity = 1;
-  fake.positive = true;
-  onyxNaturalAdd(self, lhs, &fake, vm);
-}
+/*
+ * Algorithms - Scratch
+ *
+ * The temporary digits are taken from an arena owned by the VM and used as a
+ * stack: the buffers are released in the reverse order of their allocation.
+ * The arena keeps its capacity between the calls, so that the steady state
+ * does not allocate. When a buffer does not fit, a new block is chained, and
+ * the blocks are merged into one when the arena is empty again.
+ */
 
-static void onyxNaturalSub(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  assert(lhs->size > 0);
-  assert(rhs->size > 0);
-  assert(onyxNaturalCmp(lhs, rhs) >= 0);
+#ifndef ONYX_SCRATCH_BLOCK_SIZE
+#define ONYX_SCRATCH_BLOCK_SIZE 1024
+#endif
 
-  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
-  onyxNaturalEnsureCapacity(self, size, vm);
+typedef struct OnyxScratchBlock {
+  struct OnyxScratchBlock *previous;
+  ptrdiff_t size;
+  ptrdiff_t capacity;
+  OnyxDigit digits[];
+} OnyxScratchBlock;
 
-  uint64_t carry = 0;
+typedef struct {
+  OnyxScratchBlock *top;
+  ptrdiff_t capacity; // of all the blocks in the chain
+  ptrdiff_t merged_capacity; // of the block after a merge
+} OnyxScratch;
+
+static void onyxScratchCreate(OnyxScratch *self) {
+  self->top = NULL;
+  self->capacity = 0;
+  self->merged_capacity = 0;
+}
 
-  for (ptrdiff_t i = 0; i < size; ++i) {
-    uint64_t l = onyxNaturalGet(lhs, i);
-    uint64_t r = onyxNaturalGet(rhs, i);
+static void onyxScratchDestroy(OnyxScratch *self, AgateVM *vm) {
+  assert(self->top == NULL || (self->top->previous == NULL && self->top->size == 0));
 
-    if (l >= r + carry) {
-      uint64_t difference = l - r - carry;
-      self->digits[i] = difference;
-      carry = (difference >> 32);
-      assert(carry == 0 || carry == 1);
-    } else {
-      uint64_t difference = BASE + l - r - carry;
-      self->digits[i] = difference;
-      carry = 1 + (difference >> 32);
-      assert(carry == 1);
-    }
+  if (self->top != NULL) {
+    onyxMemoryAllocate(vm, self->top, 0);
   }
 
-  assert(carry == 0);
-  self->size = size;
-  onyxNaturalNormalize(self);
+  onyxScratchCreate(self);
 }
 
-static void onyxNaturalMulBasic(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  assert(lhs->size > 0);
-  assert(rhs->size > 0);
+static OnyxScratchBlock *onyxScratchBlockNew(OnyxScratchBlock *previous, ptrdiff_t capacity, AgateVM *vm) {
+  OnyxScratchBlock *block = onyxMemoryAllocate(vm, NULL, sizeof(OnyxScratchBlock) + capacity * sizeof(OnyxDigit));
+  onyxStatsMemory(ONYX_STATS_SCRATCH_BYTES, sizeof(OnyxScratchBlock) + capacity * sizeof(OnyxDigit));
+  block->previous = previous;
+  block->size = 0;
+  block->capacity = capacity;
+  return block;
+}
 
-  ptrdiff_t size = lhs->size + rhs->size;
-  onyxNaturalEnsureCapacity(self, size, vm);
-  memset(self->digits, 0, size * sizeof(uint32_t));
+// the arena of the VM, NULL if the VM has no state yet
+static OnyxScratch *onyxScratchFind(AgateVM *vm);
 
-  for (size_t i = 0; i < lhs->size; ++i) {
-    uint64_t carry = 0;
+static OnyxDigit *onyxScratchAllocate(AgateVM *vm, ptrdiff_t size) {
+  assert(size > 0);
+  OnyxScratch *self = onyxScratchFind(vm);
 
-    for (size_t j = 0; j < rhs->size; ++j) {
-      uint64_t product = (uint64_t) lhs->digits[i] * (uint64_t) rhs->digits[j] + carry;
-      uint64_t accum = (uint64_t) self->digits[i + j] + product;
-      self->digits[i + j] = accum;
-      carry = (accum >> 32);
-      assert(carry <= UINT32_MAX);
-    }
+  if (self == NULL) {
+    return onyxMemoryAllocate(vm, NULL, size * sizeof(OnyxDigit));
+  }
+
+  OnyxScratchBlock *top = self->top;
 
-    if (carry > 0) {
-      size_t j = i + rhs->size;
-      assert(j < size);
-      assert(self->digits[j] == 0);
-      self->digits[j] = carry;
+  if (top == NULL || top->capacity - top->size < size) {
+    ptrdiff_t capacity = onyxSizeMax(size, top != NULL ? 2 * top->capacity : ONYX_SCRATCH_BLOCK_SIZE);
+
+    if (top != NULL && top->size == 0 && top->previous == NULL) {
+      // nothing is in use, the block can be replaced
+      self->capacity -= top->capacity;
+      onyxMemoryAllocate(vm, top, 0);
+      top = NULL;
     }
+
+    top = self->top = onyxScratchBlockNew(top, capacity, vm);
+    self->capacity += capacity;
+    self->merged_capacity = onyxSizeMax(self->merged_capacity, self->capacity);
   }
 
-  self->size = size;
-  onyxNaturalNormalize(self);
+  OnyxDigit *digits = top->digits + top->size;
+  top->size += size;
+  return digits;
 }
 
-// TODO: Karatsuba
-
-static void onyxNaturalMul(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  onyxNaturalMulBasic(self, lhs, rhs, vm);
-}
+static void onyxScratchRelease(AgateVM *vm, OnyxDigit *digits, ptrdiff_t size) {
+  OnyxScratch *self = onyxScratchFind(vm);
+  OnyxScratchBlock *top = self != NULL ? self->top : NULL;
 
-static void onyxNaturalMulShort(OnyxInteger *self, const OnyxInteger *lhs, uint32_t rhs, AgateVM *vm) {
-  assert(lhs->size > 0);
+  if (top == NULL || digits < top->digits || digits >= top->digits + top->capacity) {
+    // allocated before the VM had a state
+    onyxMemoryAllocate(vm, digits, 0);
+    return;
+  }
 
-  ptrdiff_t size = lhs->size + 1;
-  onyxNaturalEnsureCapacity(self, size, vm);
+  assert(digits + size == top->digits + top->size);
+  top->size -= size;
 
-  uint64_t carry = 0;
+  if (top->size > 0) {
+    return;
+  }
 
-  for (size_t i = 0; i < lhs->size; ++i) {
-    uint64_t product = (uint64_t) lhs->digits[i] * (uint64_t) rhs + carry;
-    self->digits[i] = product;
-    carry = product >> 32;
-    assert(carry <= UINT32_MAX);
+  if (top->previous != NULL) {
+    self->top = top->previous;
+    self->capacity -= top->capacity;
+    onyxMemoryAllocate(vm, top, 0);
+    return;
   }
 
-  self->digits[size - 1] = carry;
-  self->size = size;
-  onyxNaturalNormalize(self);
+  if (top->capacity < self->merged_capacity) {
+    // the arena is empty, the chain is merged in a single block
+    onyxMemoryAllocate(vm, top, 0);
+    self->top = onyxScratchBlockNew(NULL, self->merged_capacity, vm);
+    self->capacity = self->merged_capacity;
+  }
 }
 
-// https://janmr.com/blog/2012/11/basic-multiple-precision-short-division/
-static void onyxNaturalDivShort(OnyxInteger *quo, uint32_t *rem, const OnyxInteger *lhs, uint32_t rhs, AgateVM *vm) {
-  ptrdiff_t size = lhs->size;
-  uint64_t divisor = rhs;
-
-  onyxNaturalEnsureCapacity(quo, size, vm);
+/*
+ * Algorithms - Workers
+ *
+ * Large products and conversions split their independent halves in tasks
+ * that are run by a pool of threads shared by all the VMs. A task only works
+ * on raw digits or on integers allocated without a VM, it never calls back
+ * into the VM. While waiting for its tasks, a thread runs the pending tasks
+ * so that nested tasks can not starve the pool. The results do not depend on
+ * the number of threads.
+ */
 
-  uint64_t r = 0;
+typedef struct OnyxTask {
+  void (*run)(struct OnyxTask *task);
+  struct OnyxTask *next;
+  bool done;
+} OnyxTask;
 
-  for (ptrdiff_t i = 0; i < size; ++i) {
-    assert(r <= UINT32_MAX);
-    r = (r << 32) + lhs->digits[size - i - 1];
-    quo->digits[size - i - 1] = r / divisor;
-    r = r % divisor;
-  }
+#if ONYX_WORKERS
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t pending; // signaled when a task is queued or when stopping
+  pthread_cond_t finished; // signaled when a task is done
+  OnyxTask *head;
+  OnyxTask *tail;
+  bool stopping;
+  pthread_t threads[ONYX_WORKERS_MAX];
+  ptrdiff_t count;
+} OnyxWorkers;
+
+static OnyxWorkers onyxWorkers = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, false, { 0 }, 0 };
+static pthread_mutex_t onyxWorkersControl = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static atomic_ptrdiff_t onyxWorkersCount = 0;
+static atomic_ptrdiff_t onyxWorkersThreshold = ONYX_WORKERS_THRESHOLD;
+
+// checks if a task of this size is worth running in parallel
+static inline bool onyxWorkersEnabled(ptrdiff_t size) {
+  return atomic_load_explicit(&onyxWorkersCount, memory_order_relaxed) > 0 && size >= atomic_load_explicit(&onyxWorkersThreshold, memory_order_relaxed);
+}
 
-  quo->size = size;
-  onyxNaturalNormalize(quo);
+#if ONYX_WORKERS
+// must be called with the mutex locked
+static void onyxWorkersRunLocked(OnyxTask *task) {
+  onyxWorkers.head = task->next;
 
-  if (rem != NULL) {
-    *rem = r;
+  if (onyxWorkers.head == NULL) {
+    onyxWorkers.tail = NULL;
   }
+
+  pthread_mutex_unlock(&onyxWorkers.mutex);
+#if ONYX_STATS
+  // a task is a part of an operation of another thread
+  ++onyxStatsDepth;
+  task->run(task);
+  --onyxStatsDepth;
+#else
+  task->run(task);
+#endif
+  pthread_mutex_lock(&onyxWorkers.mutex);
+
+  task->done = true;
+  pthread_cond_broadcast(&onyxWorkers.finished);
 }
 
-// https://janmr.com/blog/2014/04/basic-multiple-precision-long-division/
-static void onyxNaturalDiv(OnyxInteger *quo, OnyxInteger *rem, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  assert(lhs->size > 0);
-  assert(rhs->size > 0);
+static void *onyxWorkersMain(void *data) {
+  (void) data;
+  pthread_mutex_lock(&onyxWorkers.mutex);
 
-  if (onyxNaturalCmp(lhs, rhs) < 0) {
-    onyxNaturalEnsureCapacity(quo, 1, vm);
-    quo->digits[0] = 0;
-    quo->size = 1;
-    onyxNaturalCopy(rem, lhs, vm);
-    return;
+  for (;;) {
+    if (onyxWorkers.head != NULL) {
+      onyxWorkersRunLocked(onyxWorkers.head);
+    } else if (onyxWorkers.stopping) {
+      break;
+    } else {
+      pthread_cond_wait(&onyxWorkers.pending, &onyxWorkers.mutex);
+    }
   }
 
-  if (rhs->size == 1) {
-    onyxNaturalEnsureCapacity(rem, 1, vm);
-    rem->size = 1;
-    onyxNaturalDivShort(quo, rem->digits, lhs, rhs->digits[0], vm);
-    return;
+  pthread_mutex_unlock(&onyxWorkers.mutex);
+  return NULL;
+}
+#endif
+
+// sets the number of threads of the pool, 0 to run everything in the calling thread
+static void onyxWorkersSetCount(ptrdiff_t count) {
+#if ONYX_WORKERS
+  if (count < 0) {
+    count = 0;
   }
 
-  const size_t m = lhs->size;
-  const size_t n = rhs->size;
+  if (count > ONYX_WORKERS_MAX) {
+    count = ONYX_WORKERS_MAX;
+  }
 
-  uint64_t d = BASE / ((uint64_t) rhs->digits[n - 1] + 1);
+  pthread_mutex_lock(&onyxWorkersControl);
+  atomic_store(&onyxWorkersCount, 0);
 
-  onyxNaturalMulShort(rem, lhs, d, vm);
+  // the running tasks are finished by their waiters if the threads stop before them
+  pthread_mutex_lock(&onyxWorkers.mutex);
+  onyxWorkers.stopping = true;
+  pthread_cond_broadcast(&onyxWorkers.pending);
+  pthread_mutex_unlock(&onyxWorkers.mutex);
 
-  if (rem->size == m) {
-    onyxNaturalEnsureCapacity(rem, rem->size + 1, vm);
-    rem->digits[rem->size++] = 0;
+  for (ptrdiff_t i = 0; i < onyxWorkers.count; ++i) {
+    pthread_join(onyxWorkers.threads[i], NULL);
   }
 
-  assert(rem->size == m + 1);
+  onyxWorkers.count = 0;
+  onyxWorkers.stopping = false;
 
-  OnyxInteger v;
-  onyxIntegerCreateEmpty(&v);
-  onyxNaturalMulShort(&v, rhs, d, vm);
-  assert(v.size == n);
-
-  const uint32_t v_most = v.digits[n - 1];
-  assert(v_most >= BASE / 2);
+  while (onyxWorkers.count < count && pthread_create(&onyxWorkers.threads[onyxWorkers.count], NULL, onyxWorkersMain, NULL) == 0) {
+    ++onyxWorkers.count;
+  }
 
-  OnyxInteger u;
-  u.size = u.capacity = n + 1;
+  atomic_store(&onyxWorkersCount, onyxWorkers.count);
+  pthread_mutex_unlock(&onyxWorkersControl);
+#else
+  (void) count;
+#endif
+}
 
-  assert(m >= n);
-  const ptrdiff_t k = m - n;
+static void onyxWorkersSetThreshold(ptrdiff_t threshold) {
+  atomic_store(&onyxWorkersThreshold, threshold < 1 ? 1 : threshold);
+}
 
-  onyxNaturalEnsureCapacity(quo, k + 1, vm);
-  quo->size = k + 1;
+// queues the task, or runs it if there is no pool
+static void onyxTaskStart(OnyxTask *task, void (*run)(OnyxTask *task)) {
+  task->run = run;
+  task->next = NULL;
+  task->done = false;
 
-  OnyxInteger qhv;
-  onyxIntegerCreateEmpty(&qhv);
+#if ONYX_WORKERS
+  if (atomic_load_explicit(&onyxWorkersCount, memory_order_relaxed) > 0) {
+    pthread_mutex_lock(&onyxWorkers.mutex);
 
-  OnyxInteger update;
-  onyxIntegerCreateEmpty(&update);
+    if (onyxWorkers.tail == NULL) {
+      onyxWorkers.head = task;
+    } else {
+      onyxWorkers.tail->next = task;
+    }
 
-  for (ptrdiff_t i = 0; i <= k; ++i) {
-    u.digits = rem->digits + (k - i);
+    onyxWorkers.tail = task;
+    pthread_cond_signal(&onyxWorkers.pending);
+    pthread_mutex_unlock(&onyxWorkers.mutex);
+    return;
+  }
+#endif
 
-    uint64_t qh;
-    uint64_t rh;
+  task->run(task);
+  task->done = true;
+}
 
-    assert(1 <= n && n < u.size);
+// waits for the task, running the pending tasks meanwhile
+static void onyxTaskFinish(OnyxTask *task) {
+#if ONYX_WORKERS
+  pthread_mutex_lock(&onyxWorkers.mutex);
 
-    if (u.digits[n] == v_most) {
-      qh = BASE - 1;
-      rh = (uint64_t) u.digits[n] + (uint64_t) u.digits[n - 1];
+  while (!task->done) {
+    if (onyxWorkers.head != NULL) {
+      onyxWorkersRunLocked(onyxWorkers.head);
     } else {
-      uint64_t x = (uint64_t) u.digits[n] * BASE + (uint64_t) u.digits[n - 1];
-      qh = x / v_most;
-      rh = x % v_most;
+      pthread_cond_wait(&onyxWorkers.finished, &onyxWorkers.mutex);
     }
+  }
 
-    assert(n >= 2);
-    assert(n - 2 < v.size);
-    assert(n - 2 < u.size);
-
-    while (rh < BASE && (qh * v.digits[n - 2] > BASE * rh + u.digits[n - 2])) {
-      qh = qh - 1;
-      rh = rh + v_most;
-    }
+  pthread_mutex_unlock(&onyxWorkers.mutex);
+#else
+  assert(task->done);
+#endif
+}
 
-    onyxNaturalMulShort(&qhv, &v, qh, vm);
-    int cmp = onyxNaturalCmp(&u, &qhv);
+/*
+ * Algorithms - Digits
+ *
+ * These kernels work on raw little-endian digit arrays. They do not allocate
+ * and do not normalize, the caller provides the output and the scratch space.
+ */
 
-    if (cmp < 0) {
-      qh = qh - 1;
-      onyxNaturalSub(&qhv, &qhv, &v, vm);
+static int onyxDigitsCmp(const OnyxDigit *lhs, const OnyxDigit *rhs, ptrdiff_t size) {
+  for (ptrdiff_t i = size - 1; i >= 0; --i) {
+    if (lhs[i] != rhs[i]) {
+      return lhs[i] > rhs[i] ? 1 : -1;
     }
+  }
 
-    assert(onyxNaturalCmp(&u, &qhv) >= 0);
-    onyxNaturalSub(&update, &u, &qhv, vm);
+  return 0;
+}
 
-    quo->digits[k - i] = qh;
-    memcpy(rem->digits + (k - i), update.digits, (n + 1) * sizeof(uint32_t));
+static bool onyxDigitsIsZero(const OnyxDigit *digits, ptrdiff_t size) {
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    if (digits[i] != 0) {
+      return false;
+    }
   }
 
-  onyxIntegerDestroy(&update, vm);
-  onyxIntegerDestroy(&qhv, vm);
+  return true;
+}
 
-  onyxNaturalNormalize(quo);
+#if ONYX_X86_64_ASM
+/*
+ * The loops index the digits from -size to 0 so that the counter is also the
+ * end condition. inc preserves CF for the adc/sbb chains, and lea/jrcxz do
+ * not touch the flags at all for the adcx/adox chains.
+ */
 
-  uint32_t zero;
-  onyxNaturalDivShort(rem, &zero, rem, d, vm);
-  assert(zero == UINT32_C(0));
-  onyxNaturalNormalize(rem);
+// result[0..size) = lhs + rhs, size > 0, returns the carry
+static OnyxDigit onyxDigitsAddAsm(OnyxDigit *result, const OnyxDigit *lhs, const OnyxDigit *rhs, ptrdiff_t size) {
+  OnyxDigit carry;
+  ptrdiff_t index = -size;
+
+  __asm__ volatile (
+    "clc\n"
+    "1:\n\t"
+    "movq (%[lhs],%[index],8), %[carry]\n\t"
+    "adcq (%[rhs],%[index],8), %[carry]\n\t"
+    "movq %[carry], (%[result],%[index],8)\n\t"
+    "incq %[index]\n\t"
+    "jnz 1b\n\t"
+    "sbbq %[carry], %[carry]\n\t"
+    "negq %[carry]\n"
+    : [carry] "=&r" (carry), [index] "+r" (index)
+    : [result] "r" (result + size), [lhs] "r" (lhs + size), [rhs] "r" (rhs + size)
+    : "cc", "memory"
+  );
+
+  return carry;
+}
 
-  onyxIntegerDestroy(&v, vm);
+// result[0..size) = lhs - rhs, size > 0, returns the borrow
+static OnyxDigit onyxDigitsSubAsm(OnyxDigit *result, const OnyxDigit *lhs, const OnyxDigit *rhs, ptrdiff_t size) {
+  OnyxDigit borrow;
+  ptrdiff_t index = -size;
+
+  __asm__ volatile (
+    "clc\n"
+    "1:\n\t"
+    "movq (%[lhs],%[index],8), %[borrow]\n\t"
+    "sbbq (%[rhs],%[index],8), %[borrow]\n\t"
+    "movq %[borrow], (%[result],%[index],8)\n\t"
+    "incq %[index]\n\t"
+    "jnz 1b\n\t"
+    "sbbq %[borrow], %[borrow]\n\t"
+    "negq %[borrow]\n"
+    : [borrow] "=&r" (borrow), [index] "+r" (index)
+    : [result] "r" (result + size), [lhs] "r" (lhs + size), [rhs] "r" (rhs + size)
+    : "cc", "memory"
+  );
+
+  return borrow;
 }
 
-/*
- * Algorithms - Integer
- */
+// result[0..size) += digits * factor with two independent carry chains, needs BMI2 and ADX
+static OnyxDigit onyxDigitsAddMulAdx(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  if (size == 0) {
+    return 0;
+  }
 
-static void onyxIntegerCopy(OnyxInteger *self, const OnyxInteger *other, AgateVM *vm) {
-  onyxNaturalCopy(self, other, vm);
-  self->positive = other->positive;
+  OnyxDigit high;
+  OnyxDigit low, next;
+  ptrdiff_t index = -size;
+
+  __asm__ volatile (
+    "xorl %k[high], %k[high]\n" // clears CF and OF
+    "1:\n\t"
+    "mulxq (%[digits],%%rcx,8), %[low], %[next]\n\t"
+    "adcxq (%[result],%%rcx,8), %[low]\n\t"
+    "adoxq %[high], %[low]\n\t"
+    "movq %[low], (%[result],%%rcx,8)\n\t"
+    "movq %[next], %[high]\n\t"
+    "leaq 1(%%rcx), %%rcx\n\t"
+    "jrcxz 2f\n\t"
+    "jmp 1b\n"
+    "2:\n\t"
+    "movl $0, %k[low]\n\t"
+    "adcxq %[low], %[high]\n\t"
+    "adoxq %[low], %[high]\n"
+    : [high] "=&r" (high), [low] "=&r" (low), [next] "=&r" (next), "+c" (index)
+    : [result] "r" (result + size), [digits] "r" (digits + size), "d" (factor)
+    : "cc", "memory"
+  );
+
+  return high;
 }
 
-static int onyxIntegerCmp(const OnyxInteger *lhs, const OnyxInteger *rhs) {
-  int cmp = onyxNaturalCmp(lhs, rhs);
+// result[0..size) -= digits * factor with two independent carry chains, needs BMI2 and ADX
+static OnyxDigit onyxDigitsSubMulAdx(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  if (size == 0) {
+    return 0;
+  }
+
+  OnyxDigit high;
+  OnyxDigit low, next, current;
+  ptrdiff_t index = -size;
+
+  // the subtraction is done as ~(~result + product) so that its borrow is carried by OF
+  __asm__ volatile (
+    "xorl %k[high], %k[high]\n" // clears CF and OF
+    "1:\n\t"
+    "mulxq (%[digits],%%rcx,8), %[low], %[next]\n\t"
+    "adcxq %[high], %[low]\n\t"
+    "movq (%[result],%%rcx,8), %[current]\n\t"
+    "notq %[current]\n\t"
+    "adoxq %[low], %[current]\n\t"
+    "notq %[current]\n\t"
+    "movq %[current], (%[result],%%rcx,8)\n\t"
+    "movq %[next], %[high]\n\t"
+    "leaq 1(%%rcx), %%rcx\n\t"
+    "jrcxz 2f\n\t"
+    "jmp 1b\n"
+    "2:\n\t"
+    "movl $0, %k[low]\n\t"
+    "adcxq %[low], %[high]\n\t"
+    "adoxq %[low], %[high]\n"
+    : [high] "=&r" (high), [low] "=&r" (low), [next] "=&r" (next), [current] "=&r" (current), "+c" (index)
+    : [result] "r" (result + size), [digits] "r" (digits + size), "d" (factor)
+    : "cc", "memory"
+  );
+
+  return high;
+}
+
+// result[0..size) = digits * factor, needs BMI2
+static OnyxDigit onyxDigitsMulShortBmi2(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  if (size == 0) {
+    return 0;
+  }
+
+  OnyxDigit high;
+  OnyxDigit low, next;
+  ptrdiff_t index = -size;
+
+  __asm__ volatile (
+    "xorl %k[high], %k[high]\n" // clears CF
+    "1:\n\t"
+    "mulxq (%[digits],%[index],8), %[low], %[next]\n\t"
+    "adcq %[high], %[low]\n\t"
+    "movq %[low], (%[result],%[index],8)\n\t"
+    "movq %[next], %[high]\n\t"
+    "incq %[index]\n\t"
+    "jnz 1b\n\t"
+    "adcq $0, %[high]\n"
+    : [high] "=&r" (high), [low] "=&r" (low), [next] "=&r" (next), [index] "+r" (index)
+    : [result] "r" (result + size), [digits] "r" (digits + size), "d" (factor)
+    : "cc", "memory"
+  );
+
+  return high;
+}
+#endif
+
+// result[0..lhs_size) = lhs + rhs, lhs_size >= rhs_size, result may alias lhs or rhs
+static OnyxDigit onyxDigitsAdd(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size) {
+  assert(lhs_size >= rhs_size);
+#if ONYX_X86_64_ASM
+  OnyxDoubleDigit carry = rhs_size > 0 ? onyxDigitsAddAsm(result, lhs, rhs, rhs_size) : 0;
+#else
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < rhs_size; ++i) {
+    OnyxDoubleDigit sum = carry + lhs[i] + rhs[i];
+    result[i] = sum;
+    carry = sum >> ONYX_DIGIT_BITS;
+  }
+#endif
+
+  for (ptrdiff_t i = rhs_size; i < lhs_size; ++i) {
+    OnyxDoubleDigit sum = carry + lhs[i];
+    result[i] = sum;
+    carry = sum >> ONYX_DIGIT_BITS;
+  }
+
+  return carry;
+}
+
+// result[0..lhs_size) = lhs - rhs, lhs_size >= rhs_size, result may alias lhs or rhs
+static OnyxDigit onyxDigitsSub(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size) {
+  assert(lhs_size >= rhs_size);
+#if ONYX_X86_64_ASM
+  OnyxDoubleDigit borrow = rhs_size > 0 ? onyxDigitsSubAsm(result, lhs, rhs, rhs_size) : 0;
+#else
+  OnyxDoubleDigit borrow = 0;
+
+  for (ptrdiff_t i = 0; i < rhs_size; ++i) {
+    OnyxDoubleDigit difference = (OnyxDoubleDigit) lhs[i] - rhs[i] - borrow;
+    result[i] = difference;
+    borrow = (difference >> ONYX_DIGIT_BITS) & 1;
+  }
+#endif
+
+  for (ptrdiff_t i = rhs_size; i < lhs_size; ++i) {
+    OnyxDoubleDigit difference = (OnyxDoubleDigit) lhs[i] - borrow;
+    result[i] = difference;
+    borrow = (difference >> ONYX_DIGIT_BITS) & 1;
+  }
+
+  return borrow;
+}
+
+// signed addition on fixed size operands, returns true if the result is negative
+static bool onyxDigitsAddSigned(OnyxDigit *result, const OnyxDigit *lhs, bool lhs_negative, const OnyxDigit *rhs, bool rhs_negative, ptrdiff_t size) {
+  if (lhs_negative == rhs_negative) {
+    OnyxDigit carry = onyxDigitsAdd(result, lhs, size, rhs, size);
+    assert(carry == 0);
+    (void) carry;
+    return lhs_negative;
+  }
+
+  if (onyxDigitsCmp(lhs, rhs, size) >= 0) {
+    onyxDigitsSub(result, lhs, size, rhs, size);
+    return lhs_negative;
+  }
+
+  onyxDigitsSub(result, rhs, size, lhs, size);
+  return rhs_negative;
+}
+
+static OnyxDigit onyxDigitsDivShortInPlace(OnyxDigit *digits, ptrdiff_t size, OnyxDigit divisor) {
+  OnyxDoubleDigit r = 0;
+
+  for (ptrdiff_t i = size - 1; i >= 0; --i) {
+    r = (r << ONYX_DIGIT_BITS) + digits[i];
+    digits[i] = r / divisor;
+    r = r % divisor;
+  }
+
+  return r;
+}
+
+static void onyxDigitsShiftRightOneInPlace(OnyxDigit *digits, ptrdiff_t size) {
+  for (ptrdiff_t i = 0; i < size - 1; ++i) {
+    digits[i] = (digits[i] >> 1) | (digits[i + 1] << (ONYX_DIGIT_BITS - 1));
+  }
+
+  digits[size - 1] >>= 1;
+}
+
+// result[0..size) += digits * factor, returns the carry
+static OnyxDigit onyxDigitsAddMulPortable(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit accum = (OnyxDoubleDigit) digits[i] * factor + result[i] + carry;
+    result[i] = accum;
+    carry = accum >> ONYX_DIGIT_BITS;
+  }
+
+  return carry;
+}
+
+// result[0..size) = digits * factor, returns the carry
+static OnyxDigit onyxDigitsMulShortPortable(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit product = (OnyxDoubleDigit) digits[i] * factor + carry;
+    result[i] = product;
+    carry = product >> ONYX_DIGIT_BITS;
+  }
+
+  return carry;
+}
+
+/*
+ * The multiply-accumulate kernels are selected at runtime, see
+ * onyxDigitsSelectKernels
+ */
+
+typedef OnyxDigit (*OnyxDigitsMulKernel)(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor);
+
+static OnyxDigitsMulKernel onyxDigitsAddMulKernel = onyxDigitsAddMulPortable;
+static OnyxDigitsMulKernel onyxDigitsMulShortKernel = onyxDigitsMulShortPortable;
+
+static inline OnyxDigit onyxDigitsAddMul(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  return onyxDigitsAddMulKernel(result, digits, size, factor);
+}
+
+static inline OnyxDigit onyxDigitsMulShort(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  return onyxDigitsMulShortKernel(result, digits, size, factor);
+}
+
+static void onyxDigitsMulBasic(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size) {
+  memset(result, 0, (lhs_size + rhs_size) * sizeof(OnyxDigit));
+
+  for (ptrdiff_t i = 0; i < lhs_size; ++i) {
+    result[i + rhs_size] = onyxDigitsAddMul(result + i, rhs, rhs_size, lhs[i]);
+  }
+}
+
+// result[0..2*size) = digits^2, each cross product is computed once and then doubled
+static void onyxDigitsSqrBasic(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size) {
+  memset(result, 0, 2 * size * sizeof(OnyxDigit));
+
+  for (ptrdiff_t i = 0; i < size - 1; ++i) {
+    result[i + size] = onyxDigitsAddMul(result + 2 * i + 1, digits + i + 1, size - i - 1, digits[i]);
+  }
+
+  // result = 2 * result + sum of digits[i]^2 * BASE^(2*i)
+  OnyxDigit high = 0;
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit square = (OnyxDoubleDigit) digits[i] * digits[i];
+    OnyxDigit low = result[2 * i];
+    OnyxDigit up = result[2 * i + 1];
+
+    OnyxDoubleDigit accum = (OnyxDoubleDigit) ((low << 1) | high) + (OnyxDigit) square + carry;
+    result[2 * i] = accum;
+    accum = (OnyxDoubleDigit) ((up << 1) | (low >> (ONYX_DIGIT_BITS - 1))) + (OnyxDigit) (square >> ONYX_DIGIT_BITS) + (accum >> ONYX_DIGIT_BITS);
+    result[2 * i + 1] = accum;
+    carry = accum >> ONYX_DIGIT_BITS;
+    high = up >> (ONYX_DIGIT_BITS - 1);
+  }
+
+  assert(high == 0 && carry == 0);
+}
+
+static void onyxDigitsMul(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch);
+static ptrdiff_t onyxDigitsMulScratch(ptrdiff_t lhs_size, ptrdiff_t rhs_size);
+
+// a sub-product computed by a worker, with its own scratch
+typedef struct {
+  OnyxTask task;
+  OnyxDigit *result;
+  const OnyxDigit *lhs;
+  ptrdiff_t lhs_size;
+  const OnyxDigit *rhs;
+  ptrdiff_t rhs_size;
+  OnyxDigit *scratch;
+} OnyxMulTask;
+
+static void onyxMulTaskRun(OnyxTask *task) {
+  OnyxMulTask *self = (OnyxMulTask *) task;
+  onyxDigitsMul(self->result, self->lhs, self->lhs_size, self->rhs, self->rhs_size, self->scratch);
+}
+
+static void onyxMulTaskStart(OnyxMulTask *self, OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size) {
+  const ptrdiff_t scratch_size = onyxDigitsMulScratch(lhs_size, rhs_size);
+  self->result = result;
+  self->lhs = lhs;
+  self->lhs_size = lhs_size;
+  self->rhs = rhs;
+  self->rhs_size = rhs_size;
+  self->scratch = scratch_size > 0 ? onyxMemoryAllocate(NULL, NULL, scratch_size * sizeof(OnyxDigit)) : NULL;
+  onyxTaskStart(&self->task, onyxMulTaskRun);
+}
+
+static void onyxMulTaskFinish(OnyxMulTask *self) {
+  onyxTaskFinish(&self->task);
+  onyxMemoryAllocate(NULL, self->scratch, 0);
+}
+
+// split size for Karatsuba, requires lhs_size >= rhs_size > half
+static inline ptrdiff_t onyxKaratsubaHalf(ptrdiff_t lhs_size) {
+  return (lhs_size + 1) / 2;
+}
+
+// split size for Toom-3, requires lhs_size >= rhs_size > 2 * third
+static inline ptrdiff_t onyxToom3Third(ptrdiff_t lhs_size) {
+  return (lhs_size + 2) / 3;
+}
+
+static void onyxDigitsMulKaratsuba(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch) {
+  const ptrdiff_t h = onyxKaratsubaHalf(lhs_size);
+  const ptrdiff_t size = lhs_size + rhs_size;
+  assert(lhs_size >= rhs_size && rhs_size > h);
+
+  // z0 = l0 * r0 and z2 = l1 * r1 go directly in the result
+  const bool parallel = onyxWorkersEnabled(rhs_size);
+  OnyxMulTask z0_task, z2_task;
+
+  if (parallel) {
+    onyxMulTaskStart(&z0_task, result, lhs, h, rhs, h);
+    onyxMulTaskStart(&z2_task, result + 2 * h, lhs + h, lhs_size - h, rhs + h, rhs_size - h);
+  } else {
+    onyxDigitsMul(result, lhs, h, rhs, h, scratch);
+    onyxDigitsMul(result + 2 * h, lhs + h, lhs_size - h, rhs + h, rhs_size - h, scratch);
+  }
+
+  // z1 = (l0 + l1) * (r0 + r1) - z0 - z2
+  OnyxDigit *lsum = scratch;
+  OnyxDigit *rsum = lsum + (h + 1);
+  OnyxDigit *z1 = rsum + (h + 1);
+  const ptrdiff_t z1_size = 2 * h + 2;
+
+  lsum[h] = onyxDigitsAdd(lsum, lhs, h, lhs + h, lhs_size - h);
+
+  if (lhs == rhs && lhs_size == rhs_size) {
+    // squaring, the sums are the same and the products below are squares too
+    rsum = lsum;
+  } else {
+    rsum[h] = onyxDigitsAdd(rsum, rhs, h, rhs + h, rhs_size - h);
+  }
+
+  onyxDigitsMul(z1, lsum, h + 1, rsum, h + 1, z1 + z1_size);
+
+  if (parallel) {
+    onyxMulTaskFinish(&z2_task);
+    onyxMulTaskFinish(&z0_task);
+  }
+
+  OnyxDigit borrow = onyxDigitsSub(z1, z1, z1_size, result, 2 * h);
+  borrow += onyxDigitsSub(z1, z1, z1_size, result + 2 * h, size - 2 * h);
+  assert(borrow == 0);
+
+  ptrdiff_t z1_used = z1_size < size - h ? z1_size : size - h;
+  assert(onyxDigitsIsZero(z1 + z1_used, z1_size - z1_used));
+  OnyxDigit carry = onyxDigitsAdd(result + h, result + h, size - h, z1, z1_used);
+  assert(carry == 0);
+  (void) borrow;
+  (void) carry;
+}
+
+// evaluations of d0 + d1 X + d2 X^2 at 1, -1 and -2 for Toom-3, on 'third + 1' digits
+static void onyxDigitsToom3Evaluate(OnyxDigit *at1, OnyxDigit *atm1, bool *atm1_negative, OnyxDigit *atm2, bool *atm2_negative, const OnyxDigit *digits, ptrdiff_t digits_size, ptrdiff_t third, OnyxDigit *tmp) {
+  const ptrdiff_t size = third + 1;
+  const OnyxDigit *d0 = digits;
+  const OnyxDigit *d1 = digits + third;
+  const OnyxDigit *d2 = digits + 2 * third;
+  const ptrdiff_t d2_size = digits_size - 2 * third;
+
+  // tmp = d0 + d2
+  tmp[third] = onyxDigitsAdd(tmp, d0, third, d2, d2_size);
+
+  // at1 = d0 + d1 + d2
+  OnyxDigit carry = onyxDigitsAdd(at1, tmp, size, d1, third);
+  assert(carry == 0);
+
+  // atm1 = d0 - d1 + d2
+  memcpy(atm2, d1, third * sizeof(OnyxDigit));
+  atm2[third] = 0;
+  *atm1_negative = onyxDigitsAddSigned(atm1, tmp, false, atm2, true, size);
+
+  // atm2 = 2 * (atm1 + d2) - d0
+  memcpy(tmp, d2, d2_size * sizeof(OnyxDigit));
+  memset(tmp + d2_size, 0, (size - d2_size) * sizeof(OnyxDigit));
+  *atm2_negative = onyxDigitsAddSigned(atm2, atm1, *atm1_negative, tmp, false, size);
+  carry = onyxDigitsAdd(atm2, atm2, size, atm2, size);
+  assert(carry == 0);
+  (void) carry;
+
+  memcpy(tmp, d0, third * sizeof(OnyxDigit));
+  tmp[third] = 0;
+  *atm2_negative = onyxDigitsAddSigned(atm2, atm2, *atm2_negative, tmp, true, size);
+}
+
+// Toom-3 with Bodrato's interpolation sequence, evaluation points: 0, 1, -1, -2, inf
+static void onyxDigitsMulToom3(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch) {
+  const ptrdiff_t k = onyxToom3Third(lhs_size);
+  const ptrdiff_t size = lhs_size + rhs_size;
+  assert(lhs_size >= rhs_size && rhs_size > 2 * k);
+
+  // v0 = l0 * r0 and vinf = l2 * r2 go directly in the result
+  const bool parallel = onyxWorkersEnabled(rhs_size);
+  OnyxMulTask v0_task, vinf_task, v1_task, vm1_task;
+
+  if (parallel) {
+    onyxMulTaskStart(&v0_task, result, lhs, k, rhs, k);
+    onyxMulTaskStart(&vinf_task, result + 4 * k, lhs + 2 * k, lhs_size - 2 * k, rhs + 2 * k, rhs_size - 2 * k);
+  } else {
+    onyxDigitsMul(result, lhs, k, rhs, k, scratch);
+    onyxDigitsMul(result + 4 * k, lhs + 2 * k, lhs_size - 2 * k, rhs + 2 * k, rhs_size - 2 * k, scratch);
+  }
+
+  memset(result + 2 * k, 0, 2 * k * sizeof(OnyxDigit));
+
+  const ptrdiff_t e = k + 1;
+  const ptrdiff_t n = 2 * e;
+
+  OnyxDigit *lat1 = scratch;
+  OnyxDigit *latm1 = lat1 + e;
+  OnyxDigit *latm2 = latm1 + e;
+  OnyxDigit *rat1 = latm2 + e;
+  OnyxDigit *ratm1 = rat1 + e;
+  OnyxDigit *ratm2 = ratm1 + e;
+  OnyxDigit *v1 = ratm2 + e;
+  OnyxDigit *vm1 = v1 + n;
+  OnyxDigit *vm2 = vm1 + n;
+  OnyxDigit *v0 = vm2 + n;
+  OnyxDigit *vinf = v0 + n;
+  OnyxDigit *next = vinf + n;
+
+  bool latm1_negative, latm2_negative, ratm1_negative, ratm2_negative;
+  onyxDigitsToom3Evaluate(lat1, latm1, &latm1_negative, latm2, &latm2_negative, lhs, lhs_size, k, v1);
+
+  if (lhs == rhs && lhs_size == rhs_size) {
+    // squaring, the evaluations are the same and the pointwise products are squares
+    rat1 = lat1;
+    ratm1 = latm1;
+    ratm1_negative = latm1_negative;
+    ratm2 = latm2;
+    ratm2_negative = latm2_negative;
+  } else {
+    onyxDigitsToom3Evaluate(rat1, ratm1, &ratm1_negative, ratm2, &ratm2_negative, rhs, rhs_size, k, v1);
+  }
+
+  if (parallel) {
+    onyxMulTaskStart(&v1_task, v1, lat1, e, rat1, e);
+    onyxMulTaskStart(&vm1_task, vm1, latm1, e, ratm1, e);
+    onyxDigitsMul(vm2, latm2, e, ratm2, e, next);
+    onyxMulTaskFinish(&vm1_task);
+    onyxMulTaskFinish(&v1_task);
+    onyxMulTaskFinish(&vinf_task);
+    onyxMulTaskFinish(&v0_task);
+  } else {
+    onyxDigitsMul(v1, lat1, e, rat1, e, next);
+    onyxDigitsMul(vm1, latm1, e, ratm1, e, next);
+    onyxDigitsMul(vm2, latm2, e, ratm2, e, next);
+  }
+
+  bool vm1_negative = (latm1_negative != ratm1_negative);
+  bool vm2_negative = (latm2_negative != ratm2_negative);
+
+  memcpy(v0, result, 2 * k * sizeof(OnyxDigit));
+  memset(v0 + 2 * k, 0, (n - 2 * k) * sizeof(OnyxDigit));
+  memcpy(vinf, result + 4 * k, (size - 4 * k) * sizeof(OnyxDigit));
+  memset(vinf + (size - 4 * k), 0, (n - (size - 4 * k)) * sizeof(OnyxDigit));
+
+  // interpolation, r1 = v1, r2 = vm1, r3 = vm2
+  OnyxDigit *r1 = v1;
+  OnyxDigit *r2 = vm1;
+  OnyxDigit *r3 = vm2;
+
+  // r3 = (vm2 - v1) / 3
+  bool r3_negative = onyxDigitsAddSigned(r3, vm2, vm2_negative, v1, true, n);
+  OnyxDigit remainder = onyxDigitsDivShortInPlace(r3, n, 3);
+  assert(remainder == 0);
+  (void) remainder;
+
+  // r1 = (v1 - vm1) / 2
+  bool r1_negative = onyxDigitsAddSigned(r1, v1, false, vm1, !vm1_negative, n);
+  assert((r1[0] & 1) == 0);
+  onyxDigitsShiftRightOneInPlace(r1, n);
+
+  // r2 = vm1 - v0
+  bool r2_negative = onyxDigitsAddSigned(r2, vm1, vm1_negative, v0, true, n);
+
+  // r3 = (r2 - r3) / 2 + 2 * vinf
+  r3_negative = onyxDigitsAddSigned(r3, r2, r2_negative, r3, !r3_negative, n);
+  assert((r3[0] & 1) == 0);
+  onyxDigitsShiftRightOneInPlace(r3, n);
+  r3_negative = onyxDigitsAddSigned(r3, r3, r3_negative, vinf, false, n);
+  r3_negative = onyxDigitsAddSigned(r3, r3, r3_negative, vinf, false, n);
+
+  // r2 = r2 + r1 - vinf
+  r2_negative = onyxDigitsAddSigned(r2, r2, r2_negative, r1, r1_negative, n);
+  r2_negative = onyxDigitsAddSigned(r2, r2, r2_negative, vinf, true, n);
+
+  // r1 = r1 - r3
+  r1_negative = onyxDigitsAddSigned(r1, r1, r1_negative, r3, !r3_negative, n);
+
+  // recomposition, the coefficients are non-negative
+  assert(!r1_negative || onyxDigitsIsZero(r1, n));
+  assert(!r2_negative || onyxDigitsIsZero(r2, n));
+  assert(!r3_negative || onyxDigitsIsZero(r3, n));
+  (void) r1_negative;
+  (void) r2_negative;
+  (void) r3_negative;
+
+  OnyxDigit *coefficients[3] = { r1, r2, r3 };
+
+  for (ptrdiff_t i = 1; i <= 3; ++i) {
+    ptrdiff_t offset = i * k;
+    ptrdiff_t used = n < size - offset ? n : size - offset;
+    assert(onyxDigitsIsZero(coefficients[i - 1] + used, n - used));
+    OnyxDigit carry = onyxDigitsAdd(result + offset, result + offset, size - offset, coefficients[i - 1], used);
+    assert(carry == 0);
+    (void) carry;
+  }
+}
+
+// lhs is cut in chunks of rhs_size digits that are multiplied by rhs and accumulated
+static void onyxDigitsMulUnbalanced(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch) {
+  const ptrdiff_t size = lhs_size + rhs_size;
+  assert(lhs_size >= rhs_size);
+
+  OnyxDigit *product = scratch;
+  OnyxDigit *next = product + 2 * rhs_size;
+
+  memset(result, 0, size * sizeof(OnyxDigit));
+
+  for (ptrdiff_t offset = 0; offset < lhs_size; offset += rhs_size) {
+    ptrdiff_t chunk_size = lhs_size - offset < rhs_size ? lhs_size - offset : rhs_size;
+    onyxDigitsMul(product, rhs, rhs_size, lhs + offset, chunk_size, next);
+    OnyxDigit carry = onyxDigitsAdd(result + offset, result + offset, size - offset, product, chunk_size + rhs_size);
+    assert(carry == 0);
+    (void) carry;
+  }
+}
+
+/*
+ * Algorithms - Number Theoretic Transform
+ *
+ * Products are computed modulo three primes of the form c * 2^k + 1 that fit
+ * in 31 bits, then recombined with the Chinese Remainder Theorem (Garner).
+ * The product of the primes is larger than 2^92, which is enough for a
+ * convolution of 2^28 coefficients of 32 bits. The transform size is bounded
+ * by the smallest power of two among the primes. Digits are split in 32-bit
+ * coefficients.
+ */
+
+#define ONYX_NTT_PRIME_COUNT 3
+#define ONYX_NTT_MAX_ORDER 25
+#define ONYX_NTT_SPLIT (ONYX_DIGIT_BITS / 32)
+
+typedef struct {
+  uint32_t modulus;
+  uint32_t generator;
+} OnyxNttPrime;
+
+static const OnyxNttPrime onyxNttPrimes[ONYX_NTT_PRIME_COUNT] = {
+  { UINT32_C(2113929217), UINT32_C(5) },  // 63 * 2^25 + 1
+  { UINT32_C(2013265921), UINT32_C(31) }, // 15 * 2^27 + 1
+  { UINT32_C(1811939329), UINT32_C(13) }, // 27 * 2^26 + 1
+};
+
+typedef struct {
+  uint32_t modulus;
+  uint32_t inverse; // -modulus^-1 mod 2^32
+} OnyxNttField;
+
+static void onyxNttFieldCreate(OnyxNttField *self, uint32_t modulus) {
+  uint32_t inverse = modulus; // correct on 3 bits, each iteration doubles the number of correct bits
+
+  for (int i = 0; i < 4; ++i) {
+    inverse *= 2 - modulus * inverse;
+  }
+
+  assert(modulus * inverse == 1);
+  self->modulus = modulus;
+  self->inverse = -inverse;
+}
+
+static inline uint32_t onyxNttAdd(uint32_t lhs, uint32_t rhs, const OnyxNttField *field) {
+  uint32_t sum = lhs + rhs;
+  return sum >= field->modulus ? sum - field->modulus : sum;
+}
+
+static inline uint32_t onyxNttSub(uint32_t lhs, uint32_t rhs, const OnyxNttField *field) {
+  return lhs >= rhs ? lhs - rhs : lhs + field->modulus - rhs;
+}
+
+// Montgomery multiplication: lhs * rhs * 2^-32 mod modulus
+static inline uint32_t onyxNttMul(uint32_t lhs, uint32_t rhs, const OnyxNttField *field) {
+  uint64_t product = (uint64_t) lhs * rhs;
+  uint32_t m = (uint32_t) product * field->inverse;
+  uint32_t result = (product + (uint64_t) m * field->modulus) >> 32;
+  return result >= field->modulus ? result - field->modulus : result;
+}
+
+static uint32_t onyxNttPow(uint32_t base, uint64_t exponent, uint32_t modulus) {
+  uint64_t result = 1;
+  uint64_t x = base % modulus;
+
+  while (exponent > 0) {
+    if (exponent & 1) {
+      result = result * x % modulus;
+    }
+
+    x = x * x % modulus;
+    exponent >>= 1;
+  }
+
+  return result;
+}
+
+static inline uint32_t onyxNttToMontgomery(uint32_t value, uint32_t modulus) {
+  return ((uint64_t) value << 32) % modulus;
+}
+
+// decimation in frequency, natural order to bit-reversed order
+static void onyxNttForward(uint32_t *data, ptrdiff_t size, const uint32_t *roots, const OnyxNttField *field) {
+  for (ptrdiff_t half = size / 2, stride = 1; half >= 1; half /= 2, stride *= 2) {
+    for (ptrdiff_t start = 0; start < size; start += 2 * half) {
+      uint32_t *lo = data + start;
+      uint32_t *hi = lo + half;
+
+      for (ptrdiff_t j = 0; j < half; ++j) {
+        uint32_t u = lo[j];
+        uint32_t v = hi[j];
+        lo[j] = onyxNttAdd(u, v, field);
+        hi[j] = onyxNttMul(onyxNttSub(u, v, field), roots[j * stride], field);
+      }
+    }
+  }
+}
+
+// decimation in time, bit-reversed order to natural order, without the 1/size factor
+static void onyxNttInverse(uint32_t *data, ptrdiff_t size, const uint32_t *roots, const OnyxNttField *field) {
+  for (ptrdiff_t half = 1, stride = size / 2; half < size; half *= 2, stride /= 2) {
+    for (ptrdiff_t start = 0; start < size; start += 2 * half) {
+      uint32_t *lo = data + start;
+      uint32_t *hi = lo + half;
+
+      for (ptrdiff_t j = 0; j < half; ++j) {
+        uint32_t u = lo[j];
+        uint32_t v = onyxNttMul(hi[j], roots[j * stride], field);
+        lo[j] = onyxNttAdd(u, v, field);
+        hi[j] = onyxNttSub(u, v, field);
+      }
+    }
+  }
+}
+
+// transform size for operands of lhs_size and rhs_size digits
+static inline ptrdiff_t onyxNttSize(ptrdiff_t lhs_size, ptrdiff_t rhs_size) {
+  ptrdiff_t size = 1;
+
+  while (size < (lhs_size + rhs_size) * ONYX_NTT_SPLIT - 1) {
+    size *= 2;
+  }
+
+  return size;
+}
+
+static inline bool onyxNttFits(ptrdiff_t lhs_size, ptrdiff_t rhs_size) {
+  return (lhs_size + rhs_size) * ONYX_NTT_SPLIT - 1 <= ((ptrdiff_t) 1 << ONYX_NTT_MAX_ORDER);
+}
+
+static void onyxNttLoad(uint32_t *data, ptrdiff_t size, const OnyxDigit *digits, ptrdiff_t digits_size, uint32_t modulus) {
+  for (ptrdiff_t i = 0; i < digits_size; ++i) {
+    OnyxDoubleDigit digit = digits[i];
+
+    for (ptrdiff_t j = 0; j < ONYX_NTT_SPLIT; ++j) {
+      data[i * ONYX_NTT_SPLIT + j] = (uint32_t) digit % modulus;
+      digit >>= 32;
+    }
+  }
+
+  memset(data + digits_size * ONYX_NTT_SPLIT, 0, (size - digits_size * ONYX_NTT_SPLIT) * sizeof(uint32_t));
+}
+
+// cyclic convolution of lhs and rhs modulo a prime, the result is in 'data'
+static void onyxNttConvolution(uint32_t *data, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, ptrdiff_t size, const OnyxNttPrime *prime, uint32_t *scratch) {
+  OnyxNttField field;
+  onyxNttFieldCreate(&field, prime->modulus);
+  const uint32_t modulus = prime->modulus;
+
+  uint32_t *roots = scratch;
+  uint32_t *inverse_roots = roots + size / 2;
+  uint32_t *other = inverse_roots + size / 2;
+
+  // roots[j] = w^j and inverse_roots[j] = w^-j in Montgomery form, with w a primitive size-th root of unity
+  uint32_t w = onyxNttToMontgomery(onyxNttPow(prime->generator, (modulus - 1) / size, modulus), modulus);
+  roots[0] = onyxNttToMontgomery(1, modulus);
+
+  for (ptrdiff_t j = 1; j < size / 2; ++j) {
+    roots[j] = onyxNttMul(roots[j - 1], w, &field);
+  }
+
+  inverse_roots[0] = roots[0];
+
+  for (ptrdiff_t j = 1; j < size / 2; ++j) {
+    // w^-j = -w^(size/2 - j) because w^(size/2) = -1
+    inverse_roots[j] = modulus - roots[size / 2 - j];
+  }
+
+  onyxNttLoad(data, size, lhs, lhs_size, modulus);
+  onyxNttForward(data, size, roots, &field);
+
+  if (lhs == rhs && lhs_size == rhs_size) {
+    // squaring, the pointwise product is a Montgomery product, hence the 2^-32 factor
+    for (ptrdiff_t i = 0; i < size; ++i) {
+      data[i] = onyxNttMul(data[i], data[i], &field);
+    }
+  } else {
+    onyxNttLoad(other, size, rhs, rhs_size, modulus);
+    onyxNttForward(other, size, roots, &field);
+
+    for (ptrdiff_t i = 0; i < size; ++i) {
+      data[i] = onyxNttMul(data[i], other[i], &field);
+    }
+  }
+
+  onyxNttInverse(data, size, inverse_roots, &field);
+
+  // scale by size^-1 * 2^64 to remove the transform factor and the Montgomery factor
+  uint64_t r = (UINT64_C(1) << 32) % modulus;
+  uint32_t scale = (uint64_t) onyxNttPow(size, modulus - 2, modulus) * (r * r % modulus) % modulus;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    data[i] = onyxNttMul(data[i], scale, &field);
+  }
+}
+
+// the convolution for one prime computed by a worker
+typedef struct {
+  OnyxTask task;
+  uint32_t *residues;
+  const OnyxDigit *lhs;
+  ptrdiff_t lhs_size;
+  const OnyxDigit *rhs;
+  ptrdiff_t rhs_size;
+  ptrdiff_t size;
+  const OnyxNttPrime *prime;
+  uint32_t *tmp;
+} OnyxNttTask;
+
+static void onyxNttTaskRun(OnyxTask *task) {
+  OnyxNttTask *self = (OnyxNttTask *) task;
+  onyxNttConvolution(self->residues, self->lhs, self->lhs_size, self->rhs, self->rhs_size, self->size, self->prime, self->tmp);
+}
+
+static ptrdiff_t onyxDigitsMulNttScratch(ptrdiff_t lhs_size, ptrdiff_t rhs_size) {
+  ptrdiff_t coefficients = (ONYX_NTT_PRIME_COUNT + 2) * onyxNttSize(lhs_size, rhs_size);
+  return (coefficients * sizeof(uint32_t) + sizeof(OnyxDigit) - 1) / sizeof(OnyxDigit);
+}
+
+static void onyxDigitsMulNtt(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch) {
+  assert(onyxNttFits(lhs_size, rhs_size));
+  const ptrdiff_t size = onyxNttSize(lhs_size, rhs_size);
+
+  uint32_t *coefficients = (uint32_t *) scratch;
+  uint32_t *residues[ONYX_NTT_PRIME_COUNT];
+
+  for (ptrdiff_t k = 0; k < ONYX_NTT_PRIME_COUNT; ++k) {
+    residues[k] = coefficients + k * size;
+  }
+
+  if (onyxWorkersEnabled(rhs_size)) {
+    // one convolution per prime, the first one in this thread
+    OnyxNttTask tasks[ONYX_NTT_PRIME_COUNT - 1];
+
+    for (ptrdiff_t k = 1; k < ONYX_NTT_PRIME_COUNT; ++k) {
+      OnyxNttTask *task = &tasks[k - 1];
+      task->residues = residues[k];
+      task->lhs = lhs;
+      task->lhs_size = lhs_size;
+      task->rhs = rhs;
+      task->rhs_size = rhs_size;
+      task->size = size;
+      task->prime = &onyxNttPrimes[k];
+      task->tmp = onyxMemoryAllocate(NULL, NULL, 2 * size * sizeof(uint32_t));
+      onyxTaskStart(&task->task, onyxNttTaskRun);
+    }
+
+    onyxNttConvolution(residues[0], lhs, lhs_size, rhs, rhs_size, size, &onyxNttPrimes[0], coefficients + ONYX_NTT_PRIME_COUNT * size);
+
+    for (ptrdiff_t k = 1; k < ONYX_NTT_PRIME_COUNT; ++k) {
+      onyxTaskFinish(&tasks[k - 1].task);
+      onyxMemoryAllocate(NULL, tasks[k - 1].tmp, 0);
+    }
+  } else {
+    for (ptrdiff_t k = 0; k < ONYX_NTT_PRIME_COUNT; ++k) {
+      onyxNttConvolution(residues[k], lhs, lhs_size, rhs, rhs_size, size, &onyxNttPrimes[k], coefficients + ONYX_NTT_PRIME_COUNT * size);
+    }
+  }
+
+  // Garner: x = x0 + p0 * (x1 + p1 * x2)
+  const uint32_t p0 = onyxNttPrimes[0].modulus;
+  const uint32_t p1 = onyxNttPrimes[1].modulus;
+  const uint32_t p2 = onyxNttPrimes[2].modulus;
+
+  OnyxNttField f1, f2;
+  onyxNttFieldCreate(&f1, p1);
+  onyxNttFieldCreate(&f2, p2);
+
+  // inverses in Montgomery form so that a Montgomery product gives a plain product
+  const uint32_t p0_inv_p1 = onyxNttToMontgomery(onyxNttPow(p0 % p1, p1 - 2, p1), p1);
+  const uint32_t p0_inv_p2 = onyxNttToMontgomery(onyxNttPow(p0 % p2, p2 - 2, p2), p2);
+  const uint32_t p1_inv_p2 = onyxNttToMontgomery(onyxNttPow(p1 % p2, p2 - 2, p2), p2);
+  const uint64_t p0p1 = (uint64_t) p0 * p1;
+
+  assert(p0 < 2 * p2 && p1 < 2 * p2);
+
+  uint64_t carry0 = 0;
+  uint64_t carry1 = 0;
+  const ptrdiff_t words = (lhs_size + rhs_size) * ONYX_NTT_SPLIT;
+
+  for (ptrdiff_t i = 0; i < words; ++i) {
+    uint64_t w0 = 0, w1 = 0, w2 = 0;
+
+    if (i < words - 1) {
+      uint32_t x0 = residues[0][i];
+      uint32_t x0_p1 = x0 >= p1 ? x0 - p1 : x0;
+      uint32_t x0_p2 = x0 >= p2 ? x0 - p2 : x0;
+
+      uint32_t x1 = onyxNttMul(onyxNttSub(residues[1][i], x0_p1, &f1), p0_inv_p1, &f1);
+      uint32_t x1_p2 = x1 >= p2 ? x1 - p2 : x1;
+      uint32_t x2 = onyxNttMul(onyxNttSub(residues[2][i], x0_p2, &f2), p0_inv_p2, &f2);
+      x2 = onyxNttMul(onyxNttSub(x2, x1_p2, &f2), p1_inv_p2, &f2);
+
+      uint64_t low = x0 + (uint64_t) p0 * x1;
+      uint64_t mid_lo = (p0p1 & UINT32_MAX) * x2;
+      uint64_t mid_hi = (p0p1 >> 32) * x2;
+
+      w0 = (low & UINT32_MAX) + (mid_lo & UINT32_MAX);
+      w1 = (low >> 32) + (mid_lo >> 32) + (mid_hi & UINT32_MAX) + (w0 >> 32);
+      w2 = (mid_hi >> 32) + (w1 >> 32);
+      w0 &= UINT32_MAX;
+      w1 &= UINT32_MAX;
+    }
+
+    uint64_t sum = carry0 + w0;
+    uint32_t word = sum;
+
+    if (i % ONYX_NTT_SPLIT == 0) {
+      result[i / ONYX_NTT_SPLIT] = word;
+    } else {
+      result[i / ONYX_NTT_SPLIT] |= (OnyxDigit) word << (32 * (i % ONYX_NTT_SPLIT));
+    }
+
+    carry0 = carry1 + w1 + (sum >> 32);
+    carry1 = w2;
+  }
+
+  assert(carry0 == 0 && carry1 == 0);
+}
+
+// number of scratch digits needed by onyxDigitsMul, mirrors the dispatch
+static ptrdiff_t onyxDigitsMulScratch(ptrdiff_t lhs_size, ptrdiff_t rhs_size) {
+  if (lhs_size < rhs_size) {
+    return onyxDigitsMulScratch(rhs_size, lhs_size);
+  }
+
+  if (rhs_size < ONYX_MUL_KARATSUBA_THRESHOLD) {
+    return 0;
+  }
+
+  if (rhs_size >= ONYX_MUL_NTT_THRESHOLD && onyxNttFits(lhs_size, rhs_size)) {
+    return onyxDigitsMulNttScratch(lhs_size, rhs_size);
+  }
+
+  const ptrdiff_t k = onyxToom3Third(lhs_size);
+
+  if (rhs_size >= ONYX_MUL_TOOM3_THRESHOLD && rhs_size > 2 * k) {
+    ptrdiff_t scratch = 16 * (k + 1) + onyxDigitsMulScratch(k + 1, k + 1);
+    scratch = onyxSizeMax(scratch, onyxDigitsMulScratch(k, k));
+    scratch = onyxSizeMax(scratch, onyxDigitsMulScratch(lhs_size - 2 * k, rhs_size - 2 * k));
+    return scratch;
+  }
+
+  const ptrdiff_t h = onyxKaratsubaHalf(lhs_size);
+
+  if (rhs_size > h) {
+    ptrdiff_t scratch = 4 * (h + 1) + onyxDigitsMulScratch(h + 1, h + 1);
+    scratch = onyxSizeMax(scratch, onyxDigitsMulScratch(h, h));
+    scratch = onyxSizeMax(scratch, onyxDigitsMulScratch(lhs_size - h, rhs_size - h));
+    return scratch;
+  }
+
+  ptrdiff_t scratch = onyxDigitsMulScratch(rhs_size, rhs_size);
+
+  if (lhs_size % rhs_size != 0) {
+    scratch = onyxSizeMax(scratch, onyxDigitsMulScratch(rhs_size, lhs_size % rhs_size));
+  }
+
+  return 2 * rhs_size + scratch;
+}
+
+// result must not overlap lhs or rhs and must have lhs_size + rhs_size digits,
+// if lhs and rhs are the same operand, the squaring variants are used
+static void onyxDigitsMul(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit *scratch) {
+  if (lhs_size < rhs_size) {
+    onyxDigitsMul(result, rhs, rhs_size, lhs, lhs_size, scratch);
+    return;
+  }
+
+  if (lhs == rhs && lhs_size == rhs_size && lhs_size < ONYX_SQR_KARATSUBA_THRESHOLD) {
+    onyxStatsTier(ONYX_STATS_SQR_BASIC);
+    onyxDigitsSqrBasic(result, lhs, lhs_size);
+    return;
+  }
+
+  if (rhs_size < ONYX_MUL_KARATSUBA_THRESHOLD) {
+    onyxStatsTier(ONYX_STATS_MUL_BASIC);
+    onyxDigitsMulBasic(result, lhs, lhs_size, rhs, rhs_size);
+    return;
+  }
+
+  if (rhs_size >= ONYX_MUL_NTT_THRESHOLD && onyxNttFits(lhs_size, rhs_size)) {
+    onyxStatsTier(ONYX_STATS_MUL_NTT);
+    onyxDigitsMulNtt(result, lhs, lhs_size, rhs, rhs_size, scratch);
+    return;
+  }
+
+  if (rhs_size >= ONYX_MUL_TOOM3_THRESHOLD && rhs_size > 2 * onyxToom3Third(lhs_size)) {
+    onyxStatsTier(ONYX_STATS_MUL_TOOM3);
+    onyxDigitsMulToom3(result, lhs, lhs_size, rhs, rhs_size, scratch);
+    return;
+  }
+
+  if (rhs_size > onyxKaratsubaHalf(lhs_size)) {
+    onyxStatsTier(ONYX_STATS_MUL_KARATSUBA);
+    onyxDigitsMulKaratsuba(result, lhs, lhs_size, rhs, rhs_size, scratch);
+    return;
+  }
+
+  onyxStatsTier(ONYX_STATS_MUL_UNBALANCED);
+  onyxDigitsMulUnbalanced(result, lhs, lhs_size, rhs, rhs_size, scratch);
+}
+
+
+/*
+ * Algorithms - Digits division
+ *
+ * The divisor is normalized (its most significant bit is set). The basic
+ * division is Knuth's Algorithm D, the recursive division is the one from
+ * Burnikel and Ziegler, "Fast Recursive Division" (1998), as formulated in
+ * GMP. In both cases, the remainder is left in place of the dividend.
+ */
+
+static unsigned onyxDigitLeadingZeros(OnyxDigit digit) {
+  assert(digit != 0);
+  unsigned count = 0;
+
+  while ((digit & ((OnyxDigit) 1 << (ONYX_DIGIT_BITS - 1))) == 0) {
+    digit <<= 1;
+    ++count;
+  }
+
+  return count;
+}
+
+// result[0..size) = digits << shift, returns the digit shifted out, result may alias digits
+static OnyxDigit onyxDigitsShiftLeft(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, unsigned shift) {
+  assert(shift < ONYX_DIGIT_BITS);
+
+  if (shift == 0) {
+    memmove(result, digits, size * sizeof(OnyxDigit));
+    return 0;
+  }
+
+  OnyxDigit out = digits[size - 1] >> (ONYX_DIGIT_BITS - shift);
+
+  for (ptrdiff_t i = size - 1; i > 0; --i) {
+    result[i] = (digits[i] << shift) | (digits[i - 1] >> (ONYX_DIGIT_BITS - shift));
+  }
+
+  result[0] = digits[0] << shift;
+  return out;
+}
+
+// result[0..size) = digits >> shift, result may alias digits
+static void onyxDigitsShiftRight(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, unsigned shift) {
+  assert(shift < ONYX_DIGIT_BITS);
+
+  if (shift == 0) {
+    memmove(result, digits, size * sizeof(OnyxDigit));
+    return;
+  }
+
+  for (ptrdiff_t i = 0; i < size - 1; ++i) {
+    result[i] = (digits[i] >> shift) | (digits[i + 1] << (ONYX_DIGIT_BITS - shift));
+  }
+
+  result[size - 1] = digits[size - 1] >> shift;
+}
+
+// result[0..size) -= digits * factor, returns the digit to subtract from result[size]
+static OnyxDigit onyxDigitsSubMulPortable(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  OnyxDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit product = (OnyxDoubleDigit) digits[i] * factor + carry;
+    OnyxDigit low = (OnyxDigit) product;
+    carry = product >> ONYX_DIGIT_BITS;
+    OnyxDigit r = result[i];
+    result[i] = r - low;
+    carry += (r < low);
+  }
+
+  return carry;
+}
+
+static OnyxDigitsMulKernel onyxDigitsSubMulKernel = onyxDigitsSubMulPortable;
+
+static inline OnyxDigit onyxDigitsSubMul(OnyxDigit *result, const OnyxDigit *digits, ptrdiff_t size, OnyxDigit factor) {
+  return onyxDigitsSubMulKernel(result, digits, size, factor);
+}
+
+// selects the fastest kernels for the CPU, called when the unit is loaded
+static void onyxDigitsSelectKernels(void) {
+#if ONYX_X86_64_ASM
+  unsigned eax, ebx, ecx, edx;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return;
+  }
+
+  const bool bmi2 = (ebx & bit_BMI2) != 0;
+  const bool adx = (ebx & bit_ADX) != 0;
+
+  if (bmi2) {
+    onyxDigitsMulShortKernel = onyxDigitsMulShortBmi2;
+  }
+
+  if (bmi2 && adx) {
+    onyxDigitsAddMulKernel = onyxDigitsAddMulAdx;
+    onyxDigitsSubMulKernel = onyxDigitsSubMulAdx;
+  }
+#endif
+}
+
+// digits[0..size) -= 1, returns the borrow
+static OnyxDigit onyxDigitsDecrement(OnyxDigit *digits, ptrdiff_t size) {
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    if (digits[i]-- != 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// num[0..num_size) / den[0..den_size), quo receives num_size - den_size digits,
+// returns the most significant digit of the quotient (0 or 1)
+static OnyxDigit onyxDigitsDivBasic(OnyxDigit *quo, OnyxDigit *num, ptrdiff_t num_size, const OnyxDigit *den, ptrdiff_t den_size) {
+  assert(den_size >= 2);
+  assert(num_size >= den_size);
+  assert(den[den_size - 1] >> (ONYX_DIGIT_BITS - 1) == 1);
+
+  OnyxDigit high = 0;
+  OnyxDigit *top = num + num_size - den_size;
+
+  if (onyxDigitsCmp(top, den, den_size) >= 0) {
+    onyxDigitsSub(top, top, den_size, den, den_size);
+    high = 1;
+  }
+
+  const OnyxDigit d1 = den[den_size - 1];
+  const OnyxDigit d0 = den[den_size - 2];
+
+  for (ptrdiff_t i = num_size - den_size - 1; i >= 0; --i) {
+    OnyxDigit *u = num + i;
+    OnyxDoubleDigit qh;
+    OnyxDoubleDigit rh;
+
+    if (u[den_size] >= d1) {
+      assert(u[den_size] == d1);
+      qh = BASE - 1;
+      rh = (OnyxDoubleDigit) u[den_size] + u[den_size - 1];
+    } else {
+      OnyxDoubleDigit x = (OnyxDoubleDigit) u[den_size] << ONYX_DIGIT_BITS | u[den_size - 1];
+      qh = x / d1;
+      rh = x % d1;
+    }
+
+    while (rh < BASE && qh * d0 > (rh << ONYX_DIGIT_BITS | u[den_size - 2])) {
+      --qh;
+      rh += d1;
+    }
+
+    OnyxDigit borrow = onyxDigitsSubMul(u, den, den_size, (OnyxDigit) qh);
+    OnyxDigit most = u[den_size];
+    u[den_size] = most - borrow;
+
+    if (most < borrow) {
+      --qh;
+      u[den_size] += onyxDigitsAdd(u, u, den_size, den, den_size);
+      assert(u[den_size] == 0);
+    }
+
+    quo[i] = (OnyxDigit) qh;
+  }
+
+  return high;
+}
+
+// num[0..2 * size) / den[0..size), quo receives size digits, returns the most significant digit of the quotient
+static OnyxDigit onyxDigitsDivRecursive(OnyxDigit *quo, OnyxDigit *num, const OnyxDigit *den, ptrdiff_t size, OnyxDigit *scratch) {
+  if (size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    return onyxDigitsDivBasic(quo, num, 2 * size, den, size);
+  }
+
+  const ptrdiff_t lo = size / 2;
+  const ptrdiff_t hi = size - lo;
+  OnyxDigit *product = scratch;
+  OnyxDigit *next = product + size;
+
+  // high half of the quotient, estimated with the high half of the divisor then corrected
+  OnyxDigit qh = onyxDigitsDivRecursive(quo + lo, num + 2 * lo, den + lo, hi, scratch);
+  onyxDigitsMul(product, quo + lo, hi, den, lo, next);
+  OnyxDigit borrow = onyxDigitsSub(num + lo, num + lo, size, product, size);
+
+  if (qh != 0) {
+    borrow += onyxDigitsSub(num + size, num + size, lo, den, lo);
+  }
+
+  while (borrow != 0) {
+    qh -= onyxDigitsDecrement(quo + lo, hi);
+    borrow -= onyxDigitsAdd(num + lo, num + lo, size, den, size);
+  }
+
+  // low half of the quotient, same method
+  OnyxDigit ql = onyxDigitsDivRecursive(quo, num + hi, den + hi, lo, scratch);
+  onyxDigitsMul(product, den, hi, quo, lo, next);
+  borrow = onyxDigitsSub(num, num, size, product, size);
+
+  if (ql != 0) {
+    borrow += onyxDigitsSub(num + lo, num + lo, hi, den, hi);
+  }
+
+  while (borrow != 0) {
+    onyxDigitsDecrement(quo, lo);
+    borrow -= onyxDigitsAdd(num, num, size, den, size);
+  }
+
+  return qh;
+}
+
+// num[0..den_size + size) / den[0..den_size) with size <= den_size, quo receives size digits
+static OnyxDigit onyxDigitsDivBlock(OnyxDigit *quo, OnyxDigit *num, const OnyxDigit *den, ptrdiff_t den_size, ptrdiff_t size, OnyxDigit *scratch) {
+  assert(size <= den_size);
+
+  if (size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    return onyxDigitsDivBasic(quo, num, den_size + size, den, den_size);
+  }
+
+  const ptrdiff_t lo = den_size - size;
+
+  // estimate with the high part of the divisor then correct
+  OnyxDigit qh = onyxDigitsDivRecursive(quo, num + lo, den + lo, size, scratch);
+
+  if (lo == 0) {
+    return qh;
+  }
+
+  OnyxDigit *product = scratch;
+  onyxDigitsMul(product, quo, size, den, lo, product + den_size);
+  OnyxDigit borrow = onyxDigitsSub(num, num, den_size, product, den_size);
+
+  if (qh != 0) {
+    borrow += onyxDigitsSub(num + size, num + size, lo, den, lo);
+  }
+
+  while (borrow != 0) {
+    qh -= onyxDigitsDecrement(quo, size);
+    borrow -= onyxDigitsAdd(num, num, den_size, den, den_size);
+  }
+
+  return qh;
+}
+
+static ptrdiff_t onyxDigitsDivRecursiveScratch(ptrdiff_t size) {
+  if (size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    return 0;
+  }
+
+  const ptrdiff_t lo = size / 2;
+  const ptrdiff_t hi = size - lo;
+
+  ptrdiff_t scratch = size + onyxDigitsMulScratch(hi, lo);
+  scratch = onyxSizeMax(scratch, onyxDigitsDivRecursiveScratch(hi));
+  scratch = onyxSizeMax(scratch, onyxDigitsDivRecursiveScratch(lo));
+  return scratch;
+}
+
+// number of scratch digits needed by onyxDigitsDiv
+static ptrdiff_t onyxDigitsDivScratch(ptrdiff_t num_size, ptrdiff_t den_size) {
+  const ptrdiff_t quo_size = num_size - den_size;
+
+  if (den_size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD || quo_size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    return 0;
+  }
+
+  ptrdiff_t first = quo_size % den_size;
+  ptrdiff_t scratch = onyxDigitsDivRecursiveScratch(den_size);
+
+  if (first >= ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    scratch = onyxSizeMax(scratch, onyxDigitsDivRecursiveScratch(first));
+    scratch = onyxSizeMax(scratch, den_size + onyxDigitsMulScratch(first, den_size - first));
+  }
+
+  return scratch;
+}
+
+// num[0..num_size) / den[0..den_size), quo receives num_size - den_size digits,
+// returns the most significant digit of the quotient (0 or 1)
+static OnyxDigit onyxDigitsDiv(OnyxDigit *quo, OnyxDigit *num, ptrdiff_t num_size, const OnyxDigit *den, ptrdiff_t den_size, OnyxDigit *scratch) {
+  const ptrdiff_t quo_size = num_size - den_size;
+
+  if (den_size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD || quo_size < ONYX_DIV_BURNIKEL_ZIEGLER_THRESHOLD) {
+    onyxStatsTier(ONYX_STATS_DIV_BASIC);
+    return onyxDigitsDivBasic(quo, num, num_size, den, den_size);
+  }
+
+  onyxStatsTier(ONYX_STATS_DIV_BURNIKEL_ZIEGLER);
+  OnyxDigit high = 0;
+  OnyxDigit *top = num + quo_size;
+
+  if (onyxDigitsCmp(top, den, den_size) >= 0) {
+    onyxDigitsSub(top, top, den_size, den, den_size);
+    high = 1;
+  }
+
+  // the quotient is computed by blocks of den_size digits, from the top, the first block may be smaller
+  ptrdiff_t offset = quo_size;
+  ptrdiff_t size = quo_size % den_size;
+
+  if (size == 0) {
+    size = den_size;
+  }
+
+  while (offset > 0) {
+    offset -= size;
+    OnyxDigit qh = onyxDigitsDivBlock(quo + offset, num + offset, den, den_size, size, scratch);
+    assert(qh == 0);
+    (void) qh;
+    size = den_size;
+  }
+
+  return high;
+}
+
+/*
+ * Algorithms - Natural
+ */
+
+static void onyxNaturalEnsureCapacity(OnyxInteger *self, ptrdiff_t capacity, AgateVM *vm) {
+  assert(capacity > 0);
+
+  if (self->capacity >= capacity) {
+    return;
+  }
+
+  if (self->capacity > 1) {
+    while (self->capacity < capacity) {
+      self->capacity += self->capacity / 2;
+    }
+  } else {
+    self->capacity = capacity;
+  }
+
+  assert(self->capacity >= capacity);
+
+  if (self->digits == self->small) {
+    self->digits = onyxMemoryAllocate(vm, NULL, self->capacity * sizeof(OnyxDigit));
+    memcpy(self->digits, self->small, sizeof(self->small));
+    onyxStatsMemory(ONYX_STATS_ALLOCATIONS, 1);
+  } else {
+    self->digits = onyxMemoryAllocate(vm, self->digits, self->capacity * sizeof(OnyxDigit));
+    onyxStatsMemory(ONYX_STATS_REGROWTHS, 1);
+  }
+
+  onyxStatsMemory(ONYX_STATS_ALLOCATED_BYTES, self->capacity * sizeof(OnyxDigit));
+}
+
+static void onyxNaturalCopy(OnyxInteger *self, const OnyxInteger *other, AgateVM *vm) {
+  if (self == other) {
+    return;
+  }
+
+  onyxNaturalEnsureCapacity(self, other->size, vm);
+  self->size = other->size;
+  memcpy(self->digits, other->digits, other->size * sizeof(OnyxDigit));
+}
+
+static inline OnyxDigit onyxNaturalGet(const OnyxInteger *self, ptrdiff_t i) {
+  return (i < self->size) ? self->digits[i] : 0;
+}
+
+static void onyxNaturalNormalize(OnyxInteger *self) {
+  while (self->size > 1 && self->digits[self->size - 1] == 0) {
+    --self->size;
+  }
+}
+
+static int onyxNaturalCmp(const OnyxInteger *lhs, const OnyxInteger *rhs) {
+  assert(lhs->size > 0);
+  assert(rhs->size > 0);
+
+  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDigit l = onyxNaturalGet(lhs, size - i - 1);
+    OnyxDigit r = onyxNaturalGet(rhs, size - i - 1);
+
+    if (l > r) {
+      return 1;
+    }
+    if (l < r) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static ptrdiff_t onyxNaturalBitLength(const OnyxInteger *self) {
+  assert(self->size > 0);
+  OnyxDigit most = self->digits[self->size - 1];
+
+  if (most == 0) {
+    assert(self->size == 1);
+    return 0;
+  }
+
+  return self->size * ONYX_DIGIT_BITS - onyxDigitLeadingZeros(most);
+}
+
+static inline bool onyxNaturalBit(const OnyxInteger *self, ptrdiff_t i) {
+  ptrdiff_t index = i / ONYX_DIGIT_BITS;
+
+  if (index >= self->size) {
+    return false;
+  }
+
+  return (self->digits[index] >> (i % ONYX_DIGIT_BITS)) & 1;
+}
+
+static int onyxNaturalCmpZero(const OnyxInteger *self) {
+  for (ptrdiff_t i = 0; i < self->size; ++i) {
+    if (self->digits[i] != 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void onyxNaturalAdd(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+  assert(rhs->size > 0);
+
+  const uint64_t stats_start = onyxStatsEnter();
+  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
+  onyxNaturalEnsureCapacity(self, size + 1, vm);
+
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit l = onyxNaturalGet(lhs, i);
+    OnyxDoubleDigit r = onyxNaturalGet(rhs, i);
+    OnyxDoubleDigit sum = carry + l + r;
+    self->digits[i] = sum;
+    carry = (sum >> ONYX_DIGIT_BITS);
+    assert(carry == 0 || carry == 1);
+  }
+
+  self->size = size;
+
+  if (carry == 1) {
+    self->digits[self->size++] = carry;
+  }
+
+  onyxStatsLeave(stats_start, ONYX_STATS_ADD, size);
+}
+
+static void onyxNaturalAddShort(OnyxInteger *self, const OnyxInteger *lhs, OnyxDigit rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+
+  ptrdiff_t size = lhs->size;
+  onyxNaturalEnsureCapacity(self, size + 1, vm);
+
+  OnyxDigit carry = rhs;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDigit sum = lhs->digits[i] + carry;
+    carry = (sum < carry);
+    self->digits[i] = sum;
+  }
+
+  self->size = size;
+
+  if (carry != 0) {
+    self->digits[self->size++] = carry;
+  }
+}
+
+static int onyxNaturalCmpShort(const OnyxInteger *lhs, OnyxDigit rhs) {
+  assert(lhs->size > 0);
+
+  if (lhs->size > 1) {
+    return 1;
+  }
+
+  if (lhs->digits[0] > rhs) {
+    return 1;
+  }
+
+  if (lhs->digits[0] < rhs) {
+    return -1;
+  }
+
+  return 0;
+}
+
+static void onyxNaturalSub(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+  assert(rhs->size > 0);
+  assert(onyxNaturalCmp(lhs, rhs) >= 0);
+
+  const uint64_t stats_start = onyxStatsEnter();
+  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  OnyxDoubleDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit l = onyxNaturalGet(lhs, i);
+    OnyxDoubleDigit r = onyxNaturalGet(rhs, i);
+
+    if (l >= r + carry) {
+      OnyxDoubleDigit difference = l - r - carry;
+      self->digits[i] = difference;
+      carry = (difference >> ONYX_DIGIT_BITS);
+      assert(carry == 0 || carry == 1);
+    } else {
+      OnyxDoubleDigit difference = BASE + l - r - carry;
+      self->digits[i] = difference;
+      carry = 1 + (difference >> ONYX_DIGIT_BITS);
+      assert(carry == 1);
+    }
+  }
+
+  assert(carry == 0);
+  self->size = size;
+  onyxNaturalNormalize(self);
+
+  onyxStatsLeave(stats_start, ONYX_STATS_SUB, size);
+}
+
+static void onyxNaturalSubShort(OnyxInteger *self, const OnyxInteger *lhs, OnyxDigit rhs, AgateVM *vm) {
+  assert(onyxNaturalCmpShort(lhs, rhs) >= 0);
+
+  ptrdiff_t size = lhs->size;
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  OnyxDigit borrow = rhs;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDigit l = lhs->digits[i];
+    self->digits[i] = l - borrow;
+    borrow = (l < borrow);
+  }
+
+  assert(borrow == 0);
+  self->size = size;
+  onyxNaturalNormalize(self);
+}
+
+static void onyxNaturalMul(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+  assert(rhs->size > 0);
+
+  if (self == lhs || self == rhs) {
+    OnyxInteger tmp;
+    onyxIntegerCreateEmpty(&tmp);
+    onyxNaturalMul(&tmp, lhs, rhs, vm);
+    tmp.positive = self->positive;
+    onyxIntegerMove(self, &tmp, vm);
+    return;
+  }
+
+  const uint64_t stats_start = onyxStatsEnter();
+  ptrdiff_t size = lhs->size + rhs->size;
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  ptrdiff_t scratch_size = onyxDigitsMulScratch(lhs->size, rhs->size);
+  OnyxDigit *scratch = NULL;
+
+  if (scratch_size > 0) {
+    scratch = onyxScratchAllocate(vm, scratch_size);
+  }
+
+  onyxDigitsMul(self->digits, lhs->digits, lhs->size, rhs->digits, rhs->size, scratch);
+
+  if (scratch != NULL) {
+    onyxScratchRelease(vm, scratch, scratch_size);
+  }
+
+  self->size = size;
+  onyxNaturalNormalize(self);
+
+  onyxStatsLeave(stats_start, lhs == rhs ? ONYX_STATS_SQR : ONYX_STATS_MUL, onyxSizeMax(lhs->size, rhs->size));
+}
+
+static void onyxNaturalMulShort(OnyxInteger *self, const OnyxInteger *lhs, OnyxDigit rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+
+  ptrdiff_t size = lhs->size + 1;
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  self->digits[size - 1] = onyxDigitsMulShort(self->digits, lhs->digits, lhs->size, rhs);
+  self->size = size;
+  onyxNaturalNormalize(self);
+}
+
+// https://janmr.com/blog/2012/11/basic-multiple-precision-short-division/
+static void onyxNaturalDivShort(OnyxInteger *quo, OnyxDigit *rem, const OnyxInteger *lhs, OnyxDigit rhs, AgateVM *vm) {
+  ptrdiff_t size = lhs->size;
+  OnyxDoubleDigit divisor = rhs;
+
+  onyxNaturalEnsureCapacity(quo, size, vm);
+
+  OnyxDoubleDigit r = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    assert(r <= ONYX_DIGIT_MAX);
+    r = (r << ONYX_DIGIT_BITS) + lhs->digits[size - i - 1];
+    quo->digits[size - i - 1] = r / divisor;
+    r = r % divisor;
+  }
+
+  quo->size = size;
+  onyxNaturalNormalize(quo);
+
+  if (rem != NULL) {
+    *rem = r;
+  }
+}
+
+static OnyxDigit onyxNaturalModShort(const OnyxInteger *lhs, OnyxDigit rhs) {
+  OnyxDoubleDigit r = 0;
+
+  for (ptrdiff_t i = lhs->size - 1; i >= 0; --i) {
+    r = ((r << ONYX_DIGIT_BITS) | lhs->digits[i]) % rhs;
+  }
+
+  return r;
+}
+
+static void onyxNaturalDiv(OnyxInteger *quo, OnyxInteger *rem, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  assert(lhs->size > 0);
+  assert(rhs->size > 0);
+
+  // quo and rem may alias lhs
+  const uint64_t stats_start = onyxStatsEnter();
+  const ptrdiff_t stats_size = lhs->size;
+
+  if (onyxNaturalCmp(lhs, rhs) < 0) {
+    onyxNaturalCopy(rem, lhs, vm);
+    onyxNaturalEnsureCapacity(quo, 1, vm);
+    quo->digits[0] = 0;
+    quo->size = 1;
+    onyxStatsLeave(stats_start, ONYX_STATS_DIV, stats_size);
+    return;
+  }
+
+  if (rhs->size == 1) {
+    OnyxDigit r;
+    onyxNaturalDivShort(quo, &r, lhs, rhs->digits[0], vm);
+    onyxNaturalEnsureCapacity(rem, 1, vm);
+    rem->digits[0] = r;
+    rem->size = 1;
+    onyxStatsLeave(stats_start, ONYX_STATS_DIV, stats_size);
+    return;
+  }
+
+  const ptrdiff_t m = lhs->size;
+  const ptrdiff_t n = rhs->size;
+  assert(m >= n);
+
+  // normalize so that the most significant bit of the divisor is set, the
+  // dividend gets an additional digit so that the quotient fits in m + 1 - n digits
+  const unsigned shift = onyxDigitLeadingZeros(rhs->digits[n - 1]);
+  const ptrdiff_t scratch_size = onyxDigitsDivScratch(m + 1, n);
+
+  const ptrdiff_t buffer_size = m + 1 + n + scratch_size;
+  OnyxDigit local[4 * ONYX_INTEGER_SMALL_SIZE];
+  OnyxDigit *u = buffer_size <= 4 * ONYX_INTEGER_SMALL_SIZE ? local : onyxScratchAllocate(vm, buffer_size);
+  OnyxDigit *v = u + m + 1;
+  OnyxDigit *scratch = v + n;
+
+  u[m] = onyxDigitsShiftLeft(u, lhs->digits, m, shift);
+  onyxDigitsShiftLeft(v, rhs->digits, n, shift);
+
+  // lhs and rhs are not used anymore, quo and rem may alias them
+  const ptrdiff_t k = m + 1 - n;
+  onyxNaturalEnsureCapacity(quo, k, vm);
+  OnyxDigit qh = onyxDigitsDiv(quo->digits, u, m + 1, v, n, scratch);
+  assert(qh == 0);
+  (void) qh;
+  quo->size = k;
+  onyxNaturalNormalize(quo);
+
+  onyxNaturalEnsureCapacity(rem, n, vm);
+  onyxDigitsShiftRight(rem->digits, u, n, shift);
+  rem->size = n;
+  onyxNaturalNormalize(rem);
+
+  if (u != local) {
+    onyxScratchRelease(vm, u, buffer_size);
+  }
+
+  onyxStatsLeave(stats_start, ONYX_STATS_DIV, stats_size);
+}
+
+// result = lhs * rhs, returns the normalized size, the scratch is grown if
+// needed, it must be the last buffer taken from the arena
+static ptrdiff_t onyxNaturalPowMul(OnyxDigit *result, const OnyxDigit *lhs, ptrdiff_t lhs_size, const OnyxDigit *rhs, ptrdiff_t rhs_size, OnyxDigit **scratch, ptrdiff_t *scratch_capacity, AgateVM *vm) {
+  ptrdiff_t needed = onyxDigitsMulScratch(lhs_size, rhs_size);
+
+  if (needed > *scratch_capacity) {
+    if (*scratch != NULL) {
+      onyxScratchRelease(vm, *scratch, *scratch_capacity);
+    }
+
+    *scratch = onyxScratchAllocate(vm, needed);
+    *scratch_capacity = needed;
+  }
+
+  onyxDigitsMul(result, lhs, lhs_size, rhs, rhs_size, *scratch);
+  ptrdiff_t size = lhs_size + rhs_size;
+
+  while (size > 1 && result[size - 1] == 0) {
+    --size;
+  }
+
+  return size;
+}
+
+// self = base^exponent with base = odd * 2^zeros, odd^exponent is computed by
+// left-to-right binary exponentiation in buffers sized for the result and the
+// power of two is applied with a final shift, self may alias base
+static void onyxNaturalPow(OnyxInteger *self, const OnyxInteger *base, uint64_t exponent, AgateVM *vm) {
+  assert(exponent > 0);
+  assert(onyxNaturalCmpZero(base) > 0);
+
+  const uint64_t stats_start = onyxStatsEnter();
+  const ptrdiff_t stats_size = base->size;
+  ptrdiff_t zeros = 0;
+
+  while (base->digits[zeros / ONYX_DIGIT_BITS] == 0) {
+    zeros += ONYX_DIGIT_BITS;
+  }
+
+  while (((base->digits[zeros / ONYX_DIGIT_BITS] >> (zeros % ONYX_DIGIT_BITS)) & 1) == 0) {
+    ++zeros;
+  }
+
+  const ptrdiff_t odd_bits = onyxNaturalBitLength(base) - zeros;
+  const ptrdiff_t shift_size = (ptrdiff_t) (zeros * exponent / ONYX_DIGIT_BITS);
+  const unsigned shift = (unsigned) (zeros * exponent % ONYX_DIGIT_BITS);
+
+  if (odd_bits == 1) {
+    // base is a power of two
+    onyxNaturalEnsureCapacity(self, shift_size + 1, vm);
+    memset(self->digits, 0, shift_size * sizeof(OnyxDigit));
+    self->digits[shift_size] = (OnyxDigit) 1 << shift;
+    self->size = shift_size + 1;
+    onyxStatsLeave(stats_start, ONYX_STATS_POW, stats_size);
+    return;
+  }
+
+  // odd^k has at most k * odd_bits bits, a product of two values has at
+  // most one digit more than the sum of their sizes in bits
+  const ptrdiff_t odd_offset = zeros / ONYX_DIGIT_BITS;
+  ptrdiff_t odd_size = base->size - odd_offset;
+  const ptrdiff_t size = (ptrdiff_t) (odd_bits * exponent / ONYX_DIGIT_BITS) + 2;
+
+  const ptrdiff_t buffer_size = odd_size + 2 * size;
+  OnyxDigit *odd = onyxScratchAllocate(vm, buffer_size);
+  OnyxDigit *current = odd + odd_size;
+  OnyxDigit *next = current + size;
+
+  onyxDigitsShiftRight(odd, base->digits + odd_offset, odd_size, zeros % ONYX_DIGIT_BITS);
+
+  while (odd[odd_size - 1] == 0) {
+    --odd_size;
+  }
+
+  OnyxDigit *scratch = NULL;
+  ptrdiff_t scratch_capacity = 0;
+
+  memcpy(current, odd, odd_size * sizeof(OnyxDigit));
+  ptrdiff_t current_size = odd_size;
+
+  int bit = 63;
+
+  while (((exponent >> bit) & 1) == 0) {
+    --bit;
+  }
+
+  while (--bit >= 0) {
+    OnyxDigit *tmp;
+
+    current_size = onyxNaturalPowMul(next, current, current_size, current, current_size, &scratch, &scratch_capacity, vm);
+    assert(current_size <= size);
+    tmp = current;
+    current = next;
+    next = tmp;
+
+    if (((exponent >> bit) & 1) != 0) {
+      current_size = onyxNaturalPowMul(next, current, current_size, odd, odd_size, &scratch, &scratch_capacity, vm);
+      assert(current_size <= size);
+      tmp = current;
+      current = next;
+      next = tmp;
+    }
+  }
+
+  if (scratch != NULL) {
+    onyxScratchRelease(vm, scratch, scratch_capacity);
+  }
+
+  // base is not used anymore, self may alias it
+  onyxNaturalEnsureCapacity(self, shift_size + current_size + 1, vm);
+  memset(self->digits, 0, shift_size * sizeof(OnyxDigit));
+  self->digits[shift_size + current_size] = onyxDigitsShiftLeft(self->digits + shift_size, current, current_size, shift);
+  self->size = shift_size + current_size + 1;
+  onyxNaturalNormalize(self);
+
+  onyxScratchRelease(vm, odd, buffer_size);
+  onyxStatsLeave(stats_start, ONYX_STATS_POW, stats_size);
+}
+
+/*
+ * Algorithms - Radix conversion
+ *
+ * Characters are processed by chunks, a chunk being the largest number of
+ * characters whose value fits in a digit. Large numbers are converted with a
+ * divide-and-conquer on the powers base^(chunk_size * 2^i), that are computed
+ * once per conversion. Bases that are powers of two are converted bit by bit.
+ */
+
+static uint32_t onyxDigit(char c) {
+  if ('0' <= c && c <= '9') {
+    return c - '0';
+  }
+
+  if ('A' <= c && c <= 'Z') {
+    return c - 'A' + 10;
+  }
+
+  if ('a' <= c && c <= 'z') {
+    return c - 'a' + 10;
+  }
+
+  return UINT32_MAX;
+}
+
+static const char onyxChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+#define ONYX_RADIX_POWERS_MAX 64
+
+typedef struct {
+  uint32_t base;
+  unsigned bits; // log2(base) if base is a power of two, 0 otherwise
+  ptrdiff_t chunk_size;
+  OnyxDigit chunk; // base^chunk_size
+  OnyxInteger powers[ONYX_RADIX_POWERS_MAX]; // powers[i] = chunk^(2^i)
+  ptrdiff_t count;
+} OnyxRadix;
+
+static void onyxRadixCreate(OnyxRadix *self, uint32_t base) {
+  assert(2 <= base && base <= 36);
+  self->base = base;
+  self->bits = 0;
+
+  if ((base & (base - 1)) == 0) {
+    while (((uint32_t) 1 << self->bits) < base) {
+      ++self->bits;
+    }
+  }
+
+  self->chunk_size = 1;
+  self->chunk = base;
+
+  while (self->chunk <= ONYX_DIGIT_MAX / base) {
+    self->chunk *= base;
+    ++self->chunk_size;
+  }
+
+  self->count = 0;
+}
+
+static void onyxRadixDestroy(OnyxRadix *self, AgateVM *vm) {
+  for (ptrdiff_t i = 0; i < self->count; ++i) {
+    onyxIntegerDestroy(&self->powers[i], vm);
+  }
+}
+
+static const OnyxInteger *onyxRadixPower(OnyxRadix *self, ptrdiff_t i, AgateVM *vm) {
+  assert(i < ONYX_RADIX_POWERS_MAX);
+
+  while (self->count <= i) {
+    OnyxInteger *power = &self->powers[self->count];
+    onyxIntegerCreateEmpty(power);
+
+    if (self->count == 0) {
+      onyxNaturalEnsureCapacity(power, 1, vm);
+      power->digits[0] = self->chunk;
+      power->size = 1;
+    } else {
+      const OnyxInteger *previous = &self->powers[self->count - 1];
+      onyxNaturalMul(power, previous, previous, vm);
+    }
+
+    ++self->count;
+  }
+
+  return &self->powers[i];
+}
+
+static void onyxNaturalFromChars(OnyxInteger *self, const char *str, ptrdiff_t size, OnyxRadix *radix, AgateVM *vm);
+static void onyxNaturalToChars(const OnyxInteger *self, char *str, ptrdiff_t size, OnyxRadix *radix, AgateVM *vm);
+
+// a half of a divide-and-conquer conversion computed by a worker, without the VM
+typedef struct {
+  OnyxTask task;
+  OnyxInteger *integer;
+  const char *input;
+  char *output;
+  ptrdiff_t size;
+  OnyxRadix *radix;
+} OnyxCharsTask;
+
+static void onyxFromCharsTaskRun(OnyxTask *task) {
+  OnyxCharsTask *self = (OnyxCharsTask *) task;
+  onyxNaturalFromChars(self->integer, self->input, self->size, self->radix, NULL);
+}
+
+static void onyxToCharsTaskRun(OnyxTask *task) {
+  OnyxCharsTask *self = (OnyxCharsTask *) task;
+  onyxNaturalToChars(self->integer, self->output, self->size, self->radix, NULL);
+}
+
+// self = str[0..size) where the characters are valid in the radix, base is a power of two
+static void onyxNaturalFromCharsBits(OnyxInteger *self, const char *str, ptrdiff_t size, const OnyxRadix *radix, AgateVM *vm) {
+  const unsigned bits = radix->bits;
+  onyxNaturalEnsureCapacity(self, size * bits / ONYX_DIGIT_BITS + 1, vm);
+
+  ptrdiff_t n = 0;
+  OnyxDigit current = 0;
+  unsigned filled = 0;
+
+  for (ptrdiff_t i = size - 1; i >= 0; --i) {
+    OnyxDigit value = onyxDigit(str[i]);
+    current |= value << filled;
+    filled += bits;
+
+    if (filled >= ONYX_DIGIT_BITS) {
+      self->digits[n++] = current;
+      filled -= ONYX_DIGIT_BITS;
+      current = filled > 0 ? value >> (bits - filled) : 0;
+    }
+  }
+
+  if (filled > 0 || n == 0) {
+    self->digits[n++] = current;
+  }
+
+  self->size = n;
+  onyxNaturalNormalize(self);
+}
+
+// self = str[0..size) where the characters are valid in the radix, one pass on the digits per chunk
+static void onyxNaturalFromCharsBasic(OnyxInteger *self, const char *str, ptrdiff_t size, const OnyxRadix *radix, AgateVM *vm) {
+  const OnyxDigit base = radix->base;
+  onyxNaturalEnsureCapacity(self, size / radix->chunk_size + 1, vm);
+
+  ptrdiff_t n = 1;
+  self->digits[0] = 0;
+
+  ptrdiff_t length = size % radix->chunk_size;
+
+  if (length == 0) {
+    length = radix->chunk_size;
+  }
+
+  for (ptrdiff_t i = 0; i < size; i += length, length = radix->chunk_size) {
+    OnyxDigit factor = 1;
+    OnyxDigit value = 0;
+
+    for (ptrdiff_t j = 0; j < length; ++j) {
+      factor *= base;
+      value = value * base + onyxDigit(str[i + j]);
+    }
+
+    OnyxDoubleDigit carry = value;
+
+    for (ptrdiff_t k = 0; k < n; ++k) {
+      OnyxDoubleDigit product = (OnyxDoubleDigit) self->digits[k] * factor + carry;
+      self->digits[k] = product;
+      carry = product >> ONYX_DIGIT_BITS;
+    }
+
+    if (carry != 0) {
+      self->digits[n++] = carry;
+    }
+  }
+
+  self->size = n;
+  onyxNaturalNormalize(self);
+}
+
+// self = str[0..size) where the characters are valid in the radix
+static void onyxNaturalFromChars(OnyxInteger *self, const char *str, ptrdiff_t size, OnyxRadix *radix, AgateVM *vm) {
+  const uint64_t stats_start = onyxStatsEnter();
+
+  if (radix->bits != 0) {
+    onyxStatsTier(ONYX_STATS_RADIX_BITS);
+    onyxNaturalFromCharsBits(self, str, size, radix, vm);
+    onyxStatsLeave(stats_start, ONYX_STATS_FROM_CHARS, self->size);
+    return;
+  }
+
+  if (size < ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD * radix->chunk_size) {
+    onyxStatsTier(ONYX_STATS_RADIX_BASIC);
+    onyxNaturalFromCharsBasic(self, str, size, radix, vm);
+    onyxStatsLeave(stats_start, ONYX_STATS_FROM_CHARS, self->size);
+    return;
+  }
+
+  onyxStatsTier(ONYX_STATS_RADIX_DIVIDE_AND_CONQUER);
+
+  ptrdiff_t i = 0;
+  ptrdiff_t low_size = radix->chunk_size;
+
+  while (2 * low_size < size) {
+    low_size *= 2;
+    ++i;
+  }
+
+  OnyxInteger high;
+  onyxIntegerCreateEmpty(&high);
+
+  OnyxInteger low;
+  onyxIntegerCreateEmpty(&low);
+
+  const bool parallel = onyxWorkersEnabled(size / radix->chunk_size);
+
+  if (parallel) {
+    // the powers used by the halves are computed before, the low half is allocated without the VM
+    onyxRadixPower(radix, i, vm);
+
+    OnyxCharsTask task;
+    task.integer = &low;
+    task.input = str + size - low_size;
+    task.output = NULL;
+    task.size = low_size;
+    task.radix = radix;
+    onyxTaskStart(&task.task, onyxFromCharsTaskRun);
+    onyxNaturalFromChars(&high, str, size - low_size, radix, vm);
+    onyxTaskFinish(&task.task);
+  } else {
+    onyxNaturalFromChars(&high, str, size - low_size, radix, vm);
+    onyxNaturalFromChars(&low, str + size - low_size, low_size, radix, vm);
+  }
+
+  onyxNaturalMul(self, &high, onyxRadixPower(radix, i, vm), vm);
+  onyxNaturalAdd(self, self, &low, vm);
+  onyxNaturalNormalize(self);
+
+  onyxIntegerDestroy(&low, parallel ? NULL : vm);
+  onyxIntegerDestroy(&high, vm);
+
+  onyxStatsLeave(stats_start, ONYX_STATS_FROM_CHARS, self->size);
+}
+
+// str[0..size) = self, left-padded with zeros, base is a power of two
+static void onyxNaturalToCharsBits(const OnyxInteger *self, char *str, ptrdiff_t size, const OnyxRadix *radix) {
+  const unsigned bits = radix->bits;
+  const OnyxDigit mask = radix->base - 1;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    ptrdiff_t offset = i * bits;
+    ptrdiff_t index = offset / ONYX_DIGIT_BITS;
+    unsigned shift = offset % ONYX_DIGIT_BITS;
+    OnyxDigit value = 0;
+
+    if (index < self->size) {
+      value = self->digits[index] >> shift;
+
+      if (shift + bits > ONYX_DIGIT_BITS && index + 1 < self->size) {
+        value |= self->digits[index + 1] << (ONYX_DIGIT_BITS - shift);
+      }
+    }
+
+    str[size - i - 1] = onyxChars[value & mask];
+  }
+}
+
+// str[0..size) = self, left-padded with zeros, one pass on the digits per chunk
+static void onyxNaturalToCharsBasic(const OnyxInteger *self, char *str, ptrdiff_t size, const OnyxRadix *radix, AgateVM *vm) {
+  const OnyxDigit base = radix->base;
+  ptrdiff_t n = self->size;
+  const ptrdiff_t buffer_size = n;
+  OnyxDigit *digits = onyxScratchAllocate(vm, buffer_size);
+  memcpy(digits, self->digits, n * sizeof(OnyxDigit));
+
+  ptrdiff_t position = size;
+
+  while (n > 0 && position > 0) {
+    OnyxDigit rem = onyxDigitsDivShortInPlace(digits, n, radix->chunk);
+
+    if (digits[n - 1] == 0) {
+      --n;
+    }
+
+    for (ptrdiff_t j = 0; j < radix->chunk_size && position > 0; ++j) {
+      str[--position] = onyxChars[rem % base];
+      rem /= base;
+    }
+  }
+
+  assert(onyxDigitsIsZero(digits, n));
+  memset(str, '0', position);
+
+  onyxScratchRelease(vm, digits, buffer_size);
+}
+
+// str[0..size) = self, left-padded with zeros, size must be large enough for self
+static void onyxNaturalToChars(const OnyxInteger *self, char *str, ptrdiff_t size, OnyxRadix *radix, AgateVM *vm) {
+  const uint64_t stats_start = onyxStatsEnter();
+
+  if (radix->bits != 0) {
+    onyxStatsTier(ONYX_STATS_RADIX_BITS);
+    onyxNaturalToCharsBits(self, str, size, radix);
+    onyxStatsLeave(stats_start, ONYX_STATS_TO_CHARS, self->size);
+    return;
+  }
+
+  if (self->size < ONYX_RADIX_DIVIDE_AND_CONQUER_THRESHOLD) {
+    onyxStatsTier(ONYX_STATS_RADIX_BASIC);
+    onyxNaturalToCharsBasic(self, str, size, radix, vm);
+    onyxStatsLeave(stats_start, ONYX_STATS_TO_CHARS, self->size);
+    return;
+  }
+
+  onyxStatsTier(ONYX_STATS_RADIX_DIVIDE_AND_CONQUER);
+
+  // the largest power whose square is about the size of self
+  ptrdiff_t i = 0;
+
+  while (i + 1 < ONYX_RADIX_POWERS_MAX && 4 * onyxRadixPower(radix, i, vm)->size <= self->size) {
+    ++i;
+  }
+
+  const ptrdiff_t low_size = radix->chunk_size << i;
+  assert(low_size < size);
+
+  OnyxInteger quo;
+  onyxIntegerCreateEmpty(&quo);
+
+  OnyxInteger rem;
+  onyxIntegerCreateEmpty(&rem);
+
+  onyxNaturalDiv(&quo, &rem, self, onyxRadixPower(radix, i, vm), vm);
+
+  if (onyxWorkersEnabled(self->size)) {
+    // the powers used by the halves are all computed already
+    OnyxCharsTask task;
+    task.integer = &rem;
+    task.input = NULL;
+    task.output = str + size - low_size;
+    task.size = low_size;
+    task.radix = radix;
+    onyxTaskStart(&task.task, onyxToCharsTaskRun);
+    onyxNaturalToChars(&quo, str, size - low_size, radix, vm);
+    onyxTaskFinish(&task.task);
+  } else {
+    onyxNaturalToChars(&quo, str, size - low_size, radix, vm);
+    onyxNaturalToChars(&rem, str + size - low_size, low_size, radix, vm);
+  }
+
+  onyxIntegerDestroy(&rem, vm);
+  onyxIntegerDestroy(&quo, vm);
+
+  onyxStatsLeave(stats_start, ONYX_STATS_TO_CHARS, self->size);
+}
+
+/*
+ * Algorithms - Integer
+ */
+
+static void onyxIntegerCopy(OnyxInteger *self, const OnyxInteger *other, AgateVM *vm) {
+  onyxNaturalCopy(self, other, vm);
+  self->positive = other->positive;
+}
+
+static int onyxIntegerCmp(const OnyxInteger *lhs, const OnyxInteger *rhs) {
+  int cmp = onyxNaturalCmp(lhs, rhs);
 
   if (lhs->positive) {
     if (rhs->positive) {
       return cmp;
     }
-    if (onyxNaturalCmpZero(lhs) && onyxNaturalCmpZero(rhs)) {
-      return 0;
+    if (!onyxNaturalCmpZero(lhs) && !onyxNaturalCmpZero(rhs)) {
+      return 0;
+    }
+    return 1;
+  }
+
+  if (!rhs->positive) {
+    return -cmp;
+  }
+  if (!onyxNaturalCmpZero(lhs) && !onyxNaturalCmpZero(rhs)) {
+    return 0;
+  }
+  return -1;
+}
+
+static int onyxIntegerCmpZero(const OnyxInteger *self) {
+  int cmp = onyxNaturalCmpZero(self);
+  return self->positive ? cmp : -cmp;
+}
+
+// signs are given separately so that self may alias lhs or rhs
+static void onyxIntegerAddSigned(OnyxInteger *self, const OnyxInteger *lhs, bool lhs_positive, const OnyxInteger *rhs, bool rhs_positive, AgateVM *vm) {
+  if (lhs_positive == rhs_positive) {
+    onyxNaturalAdd(self, lhs, rhs, vm);
+    self->positive = lhs_positive;
+    return;
+  }
+
+  int cmp = onyxNaturalCmp(lhs, rhs);
+
+  if (cmp > 0) {
+    onyxNaturalSub(self, lhs, rhs, vm);
+    self->positive = lhs_positive;
+  } else {
+    onyxNaturalSub(self, rhs, lhs, vm);
+    self->positive = rhs_positive || cmp == 0;
+  }
+}
+
+static void onyxIntegerAdd(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  onyxIntegerAddSigned(self, lhs, lhs->positive, rhs, rhs->positive, vm);
+}
+
+static void onyxIntegerSub(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  onyxIntegerAddSigned(self, lhs, lhs->positive, rhs, !rhs->positive, vm);
+}
+
+static void onyxIntegerMul(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  onyxNaturalMul(self, lhs, rhs, vm);
+  self->positive = (lhs->positive == rhs->positive);
+}
+
+// self += lhs * rhs, self may alias lhs or rhs
+static void onyxIntegerAddMul(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  OnyxInteger product;
+  onyxIntegerCreateEmpty(&product);
+  onyxIntegerMul(&product, lhs, rhs, vm);
+  onyxIntegerAdd(self, self, &product, vm);
+  onyxIntegerDestroy(&product, vm);
+}
+
+/*
+ * The short variants take a digit and a sign as right operand
+ */
+
+static int onyxIntegerCmpShort(const OnyxInteger *lhs, OnyxDigit rhs, bool rhs_positive) {
+  int lhs_sign = onyxIntegerCmpZero(lhs);
+  int rhs_sign = rhs == 0 ? 0 : (rhs_positive ? 1 : -1);
+
+  if (lhs_sign != rhs_sign) {
+    return lhs_sign < rhs_sign ? -1 : 1;
+  }
+
+  int cmp = onyxNaturalCmpShort(lhs, rhs);
+  return lhs_sign >= 0 ? cmp : -cmp;
+}
+
+static void onyxIntegerAddShort(OnyxInteger *self, const OnyxInteger *lhs, OnyxDigit rhs, bool rhs_positive, AgateVM *vm) {
+  const bool lhs_positive = lhs->positive;
+
+  if (lhs_positive == rhs_positive) {
+    onyxNaturalAddShort(self, lhs, rhs, vm);
+    self->positive = lhs_positive;
+    return;
+  }
+
+  int cmp = onyxNaturalCmpShort(lhs, rhs);
+
+  if (cmp > 0) {
+    onyxNaturalSubShort(self, lhs, rhs, vm);
+    self->positive = lhs_positive;
+  } else if (cmp == 0) {
+    self->digits[0] = 0;
+    self->size = 1;
+    self->positive = true;
+  } else {
+    OnyxDigit difference = rhs - lhs->digits[0];
+    onyxNaturalEnsureCapacity(self, 1, vm);
+    self->digits[0] = difference;
+    self->size = 1;
+    self->positive = rhs_positive;
+  }
+}
+
+static void onyxIntegerMulShort(OnyxInteger *self, const OnyxInteger *lhs, OnyxDigit rhs, bool rhs_positive, AgateVM *vm) {
+  const bool lhs_positive = lhs->positive;
+  onyxNaturalMulShort(self, lhs, rhs, vm);
+  self->positive = (lhs_positive == rhs_positive) || onyxNaturalCmpZero(self) == 0;
+}
+
+// same semantics as onyxIntegerDiv: the remainder is in [0, rhs)
+static void onyxIntegerDivShort(OnyxInteger *quo, OnyxDigit *rem, const OnyxInteger *lhs, OnyxDigit rhs, bool rhs_positive, AgateVM *vm) {
+  assert(rhs != 0);
+  const bool lhs_positive = lhs->positive || onyxNaturalCmpZero(lhs) == 0;
+
+  OnyxDigit r;
+  onyxNaturalDivShort(quo, &r, lhs, rhs, vm);
+
+  if (!lhs_positive && r != 0) {
+    onyxNaturalAddShort(quo, quo, 1, vm);
+    r = rhs - r;
+  }
+
+  quo->positive = (lhs_positive == rhs_positive) || onyxNaturalCmpZero(quo) == 0;
+  *rem = r;
+}
+
+// same semantics as onyxIntegerDiv: the remainder is in [0, rhs)
+static OnyxDigit onyxIntegerModShort(const OnyxInteger *lhs, OnyxDigit rhs) {
+  assert(rhs != 0);
+  OnyxDigit r = onyxNaturalModShort(lhs, rhs);
+
+  if (!lhs->positive && r != 0) {
+    r = rhs - r;
+  }
+
+  return r;
+}
+
+static bool onyxIntegerDiv(OnyxInteger *quo, OnyxInteger *rem, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  int cmpr = onyxIntegerCmpZero(rhs);
+
+  if (cmpr == 0) {
+    return false;
+  }
+
+  if (cmpr < 0) {
+    OnyxInteger minus_rhs = *rhs;
+    minus_rhs.positive = !minus_rhs.positive;
+    bool status = onyxIntegerDiv(quo, rem, lhs, &minus_rhs, vm);
+    quo->positive = !quo->positive;
+    return status;
+  }
+
+  int cmpl = onyxIntegerCmpZero(lhs);
+
+  if (cmpl < 0) {
+    OnyxInteger minus_lhs = *lhs;
+    minus_lhs.positive = !minus_lhs.positive;
+    bool status = onyxIntegerDiv(quo, rem, &minus_lhs, rhs, vm);
+
+    int cmp = onyxIntegerCmpZero(rem);
+
+    quo->positive = !quo->positive;
+
+    if (cmp != 0) {
+      OnyxDigit digit = 1;
+      OnyxInteger one;
+      one.digits = &digit;
+      one.size = one.capacity = 1;
+      one.positive = true;
+
+      onyxIntegerSub(quo, quo, &one, vm);
+      onyxIntegerSub(rem, rhs, rem, vm);
+    }
+
+    return status;
+  }
+
+  assert(cmpr > 0);
+  assert(cmpl >= 0);
+
+  onyxNaturalDiv(quo, rem, lhs, rhs, vm);
+  quo->positive = true;
+  rem->positive = true;
+  return true;
+}
+
+// self = base^exponent, returns false if the result is too large to be computed
+static bool onyxIntegerPow(OnyxInteger *self, const OnyxInteger *base, const OnyxInteger *exponent, AgateVM *vm) {
+  assert(onyxIntegerCmpZero(exponent) >= 0);
+  const bool positive = base->positive || (exponent->digits[0] & 1) == 0;
+
+  if (onyxNaturalCmpZero(exponent) == 0) {
+    onyxNaturalEnsureCapacity(self, 1, vm);
+    self->digits[0] = 1;
+    self->size = 1;
+    self->positive = true;
+    return true;
+  }
+
+  if (onyxNaturalCmpShort(base, 1) <= 0) {
+    // 0^n = 0, 1^n = 1 and (-1)^n = +/-1 for any n > 0
+    onyxNaturalCopy(self, base, vm);
+    self->positive = positive || onyxNaturalCmpZero(base) == 0;
+    return true;
+  }
+
+  const ptrdiff_t bits = onyxNaturalBitLength(base);
+
+  if (onyxNaturalBitLength(exponent) > 62) {
+    return false;
+  }
+
+  uint64_t n = 0;
+
+  for (ptrdiff_t i = 0; i < exponent->size; ++i) {
+    n |= (uint64_t) exponent->digits[i] << (i * ONYX_DIGIT_BITS);
+  }
+
+  // the size in bits of the result must fit in a ptrdiff_t
+  if (n > (uint64_t) (PTRDIFF_MAX / bits)) {
+    return false;
+  }
+
+  onyxNaturalPow(self, base, n, vm);
+  self->positive = positive;
+  return true;
+}
+
+static void onyxIntegerFromInt(OnyxInteger *self, int64_t val, AgateVM *vm) {
+  onyxNaturalEnsureCapacity(self, ONYX_INT64_DIGITS, vm);
+  self->size = ONYX_INT64_DIGITS;
+
+  uint64_t magnitude;
+
+  if (val < 0) {
+    self->positive = false;
+    // computed on unsigned integers because -INT64_MIN is UB
+    magnitude = UINT64_C(0) - (uint64_t) val;
+  } else {
+    self->positive = true;
+    magnitude = val;
+  }
+
+  for (ptrdiff_t i = 0; i < ONYX_INT64_DIGITS; ++i) {
+    self->digits[i] = (OnyxDigit) magnitude;
+    magnitude = (OnyxDoubleDigit) magnitude >> ONYX_DIGIT_BITS;
+  }
+
+  onyxNaturalNormalize(self);
+}
+
+static bool onyxIntegerFromString(OnyxInteger *self, const char *str, uint32_t base, AgateVM *vm) {
+  if (base < 2 || base > 36) {
+    return false;
+  }
+
+  if (str[0] == '-') {
+    self->positive = false;
+    ++str;
+  } else {
+    self->positive = true;
+  }
+
+  ptrdiff_t size = 0;
+
+  while (str[size] != '\0') {
+    if (onyxDigit(str[size]) >= base) {
+      return false;
+    }
+
+    ++size;
+  }
+
+  OnyxRadix radix;
+  onyxRadixCreate(&radix, base);
+  onyxNaturalFromChars(self, str, size, &radix, vm);
+  onyxRadixDestroy(&radix, vm);
+  return true;
+}
+
+/*
+ * Algorithms - Sequences
+ *
+ * A sum is accumulated in place, the additions stop as soon as the carry is
+ * consumed. A product is computed with a balanced product tree: the factors
+ * are multiplied pairwise, so that the operands of each multiplication have
+ * similar sizes and can benefit from the fast multiplication algorithms.
+ */
+
+// self += digits, self must not alias digits
+static void onyxNaturalAccumulate(OnyxInteger *self, const OnyxDigit *digits, ptrdiff_t size, AgateVM *vm) {
+  assert(self->size > 0);
+  assert(size > 0);
+
+  if (self->size < size) {
+    onyxNaturalEnsureCapacity(self, size, vm);
+    memset(self->digits + self->size, 0, (size - self->size) * sizeof(OnyxDigit));
+    self->size = size;
+  }
+
+  OnyxDigit carry = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit sum = (OnyxDoubleDigit) self->digits[i] + digits[i] + carry;
+    self->digits[i] = (OnyxDigit) sum;
+    carry = (OnyxDigit) (sum >> ONYX_DIGIT_BITS);
+  }
+
+  for (ptrdiff_t i = size; carry != 0 && i < self->size; ++i) {
+    OnyxDigit sum = self->digits[i] + carry;
+    carry = (sum < carry);
+    self->digits[i] = sum;
+  }
+
+  if (carry != 0) {
+    onyxNaturalEnsureCapacity(self, self->size + 1, vm);
+    self->digits[self->size++] = carry;
+  }
+}
+
+// values[0] = values[0] * values[1] * ... * values[count - 1], the other values are destroyed
+static void onyxIntegerProductTree(OnyxInteger *values, ptrdiff_t count, AgateVM *vm) {
+  assert(count > 0);
+
+  for (ptrdiff_t step = 1; step < count; step *= 2) {
+    for (ptrdiff_t i = 0; i + step < count; i += 2 * step) {
+      onyxIntegerMul(&values[i], &values[i], &values[i + step], vm);
+      onyxIntegerDestroy(&values[i + step], vm);
+    }
+  }
+}
+
+/*
+ * Algorithms - Bitwise operations
+ *
+ * The semantics are the ones of an infinite two's complement representation.
+ * Negative operands are complemented on the fly, digit by digit: the two's
+ * complement of -x is ~(x - 1), so a borrow is propagated while reading them,
+ * and a carry while writing a negative result.
+ */
+
+typedef enum {
+  ONYX_BITWISE_AND,
+  ONYX_BITWISE_OR,
+  ONYX_BITWISE_XOR,
+} OnyxBitwise;
+
+// digit i of the two's complement of a negative number, borrow starts at 1
+static inline OnyxDigit onyxDigitComplement(OnyxDigit digit, OnyxDigit *borrow) {
+  OnyxDigit result = digit - *borrow;
+  *borrow = (digit < *borrow);
+  return ~result;
+}
+
+// self = lhs op rhs, self may alias lhs or rhs
+static void onyxIntegerBitwise(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, OnyxBitwise op, AgateVM *vm) {
+  const bool lhs_negative = onyxIntegerCmpZero(lhs) < 0;
+  const bool rhs_negative = onyxIntegerCmpZero(rhs) < 0;
+  bool negative = false;
+  ptrdiff_t size = onyxSizeMax(lhs->size, rhs->size);
+
+  switch (op) {
+    case ONYX_BITWISE_AND:
+      negative = lhs_negative && rhs_negative;
+
+      // the digits above a non-negative operand are all zero
+      if (!lhs_negative) {
+        size = rhs_negative ? lhs->size : (lhs->size < rhs->size ? lhs->size : rhs->size);
+      } else if (!rhs_negative) {
+        size = rhs->size;
+      }
+
+      break;
+    case ONYX_BITWISE_OR:
+      negative = lhs_negative || rhs_negative;
+      break;
+    case ONYX_BITWISE_XOR:
+      negative = lhs_negative != rhs_negative;
+      break;
+  }
+
+  // a negative result may need one more digit for its magnitude
+  size += negative;
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  OnyxDigit lhs_borrow = 1;
+  OnyxDigit rhs_borrow = 1;
+  OnyxDigit carry = 1;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDigit l = onyxNaturalGet(lhs, i);
+    OnyxDigit r = onyxNaturalGet(rhs, i);
+
+    if (lhs_negative) {
+      l = onyxDigitComplement(l, &lhs_borrow);
+    }
+
+    if (rhs_negative) {
+      r = onyxDigitComplement(r, &rhs_borrow);
+    }
+
+    OnyxDigit digit = 0;
+
+    switch (op) {
+      case ONYX_BITWISE_AND:
+        digit = l & r;
+        break;
+      case ONYX_BITWISE_OR:
+        digit = l | r;
+        break;
+      case ONYX_BITWISE_XOR:
+        digit = l ^ r;
+        break;
+    }
+
+    if (negative) {
+      // the magnitude is ~digit + 1
+      digit = ~digit + carry;
+      carry = (digit < carry);
+    }
+
+    self->digits[i] = digit;
+  }
+
+  self->size = size;
+  onyxNaturalNormalize(self);
+  self->positive = !negative;
+}
+
+// self = ~other = -other - 1, self may alias other
+static void onyxIntegerNot(OnyxInteger *self, const OnyxInteger *other, AgateVM *vm) {
+  onyxIntegerAddShort(self, other, 1, true, vm);
+  self->positive = !self->positive || onyxNaturalCmpZero(self) == 0;
+}
+
+// self = other * 2^shift, self may alias other
+static void onyxIntegerShiftLeft(OnyxInteger *self, const OnyxInteger *other, ptrdiff_t shift, AgateVM *vm) {
+  assert(shift >= 0);
+
+  if (onyxNaturalCmpZero(other) == 0) {
+    onyxIntegerCopy(self, other, vm);
+    return;
+  }
+
+  const ptrdiff_t offset = shift / ONYX_DIGIT_BITS;
+  const ptrdiff_t size = other->size;
+  const bool positive = other->positive;
+  onyxNaturalEnsureCapacity(self, offset + size + 1, vm);
+
+  // from the most significant digit, so that other may be shifted in place
+  self->digits[offset + size] = onyxDigitsShiftLeft(self->digits + offset, other->digits, size, shift % ONYX_DIGIT_BITS);
+  memset(self->digits, 0, offset * sizeof(OnyxDigit));
+  self->size = offset + size + 1;
+  onyxNaturalNormalize(self);
+  self->positive = positive;
+}
+
+// self = floor(other / 2^shift), self may alias other
+static void onyxIntegerShiftRight(OnyxInteger *self, const OnyxInteger *other, ptrdiff_t shift, AgateVM *vm) {
+  assert(shift >= 0);
+
+  const ptrdiff_t offset = shift / ONYX_DIGIT_BITS;
+  const unsigned bits = shift % ONYX_DIGIT_BITS;
+  const bool negative = onyxIntegerCmpZero(other) < 0;
+
+  if (offset >= other->size) {
+    onyxNaturalEnsureCapacity(self, 1, vm);
+    self->digits[0] = negative ? 1 : 0;
+    self->size = 1;
+    self->positive = !negative;
+    return;
+  }
+
+  // a negative value is rounded towards negative infinity if a one bit is shifted out
+  bool inexact = false;
+
+  if (negative) {
+    inexact = !onyxDigitsIsZero(other->digits, offset) || (other->digits[offset] & (((OnyxDigit) 1 << bits) - 1)) != 0;
+  }
+
+  const ptrdiff_t size = other->size - offset;
+  onyxNaturalEnsureCapacity(self, size, vm);
+  onyxDigitsShiftRight(self->digits, other->digits + offset, size, bits);
+  self->size = size;
+  onyxNaturalNormalize(self);
+
+  if (inexact) {
+    onyxNaturalAddShort(self, self, 1, vm);
+  }
+
+  self->positive = !negative;
+}
+
+// bit i of the two's complement representation of self
+static bool onyxIntegerTestBit(const OnyxInteger *self, ptrdiff_t i) {
+  if (onyxIntegerCmpZero(self) >= 0) {
+    return onyxNaturalBit(self, i);
+  }
+
+  // the bits of -x are the complement of the bits of x - 1, that differs from
+  // x up to its lowest one bit
+  ptrdiff_t lowest = 0;
+
+  while (!onyxNaturalBit(self, lowest)) {
+    ++lowest;
+  }
+
+  if (i < lowest) {
+    return false;
+  }
+
+  if (i == lowest) {
+    return true;
+  }
+
+  return !onyxNaturalBit(self, i);
+}
+
+// number of one bits of the absolute value
+static ptrdiff_t onyxNaturalPopCount(const OnyxInteger *self) {
+  ptrdiff_t count = 0;
+
+  for (ptrdiff_t i = 0; i < self->size; ++i) {
+    for (OnyxDigit digit = self->digits[i]; digit != 0; digit &= digit - 1) {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Algorithms - Bytes
+ *
+ * Values are exchanged as a sequence of bytes, either the magnitude or the
+ * two's complement, in little or big endian order. On a little endian host,
+ * the digits of a non-negative value are copied directly. The packed
+ * encoding of a value is a LEB128 header holding the size in bytes and the
+ * sign, followed by the magnitude in little endian order.
+ */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ONYX_LITTLE_ENDIAN 1
+#elif defined(_WIN32)
+#define ONYX_LITTLE_ENDIAN 1
+#else
+#define ONYX_LITTLE_ENDIAN 0
+#endif
+
+#define ONYX_DIGIT_BYTES (ONYX_DIGIT_BITS / 8)
+
+// self = value of the bytes, as a two's complement if twos_complement is true
+static void onyxIntegerFromBytes(OnyxInteger *self, const uint8_t *bytes, ptrdiff_t size, bool big_endian, bool twos_complement, AgateVM *vm) {
+  const ptrdiff_t width = (size + ONYX_DIGIT_BYTES - 1) / ONYX_DIGIT_BYTES;
+  const ptrdiff_t n = onyxSizeMax(width, 1);
+  onyxNaturalEnsureCapacity(self, n, vm);
+  memset(self->digits, 0, n * sizeof(OnyxDigit));
+
+  if (ONYX_LITTLE_ENDIAN && !big_endian) {
+    memcpy(self->digits, bytes, size);
+  } else {
+    for (ptrdiff_t i = 0; i < size; ++i) {
+      const uint8_t byte = big_endian ? bytes[size - 1 - i] : bytes[i];
+      self->digits[i / ONYX_DIGIT_BYTES] |= (OnyxDigit) byte << (8 * (i % ONYX_DIGIT_BYTES));
+    }
+  }
+
+  const bool negative = twos_complement && size > 0 && ((big_endian ? bytes[0] : bytes[size - 1]) & 0x80) != 0;
+
+  if (negative) {
+    // the magnitude is 2^(8 * size) - value, i.e. ~value + 1 on the width of the bytes
+    OnyxDigit carry = 1;
+
+    for (ptrdiff_t i = 0; i < width; ++i) {
+      OnyxDigit digit = ~self->digits[i] + carry;
+      carry = (carry != 0 && digit == 0);
+      self->digits[i] = digit;
+    }
+
+    const unsigned top_bits = 8 * (size - (width - 1) * ONYX_DIGIT_BYTES);
+
+    if (top_bits < ONYX_DIGIT_BITS) {
+      self->digits[width - 1] &= ((OnyxDigit) 1 << top_bits) - 1;
+    }
+  }
+
+  self->size = n;
+  onyxNaturalNormalize(self);
+  self->positive = !negative || onyxNaturalCmpZero(self) == 0;
+}
+
+// number of bytes needed for self, at least one, and room for the sign if twos_complement is true
+static ptrdiff_t onyxIntegerBytesSize(const OnyxInteger *self, bool twos_complement) {
+  ptrdiff_t bits = onyxNaturalBitLength(self);
+
+  if (!twos_complement) {
+    return onyxSizeMax((bits + 7) / 8, 1);
+  }
+
+  // -2^k needs k bits and a sign bit
+  if (!self->positive && onyxNaturalPopCount(self) == 1) {
+    --bits;
+  }
+
+  return bits / 8 + 1;
+}
+
+// bytes[0..size) = the lowest bytes of the two's complement of self
+static void onyxIntegerToBytes(const OnyxInteger *self, uint8_t *bytes, ptrdiff_t size, bool big_endian) {
+  const bool negative = onyxIntegerCmpZero(self) < 0;
+
+  if (ONYX_LITTLE_ENDIAN && !big_endian && !negative) {
+    const ptrdiff_t count = self->size * ONYX_DIGIT_BYTES < size ? self->size * ONYX_DIGIT_BYTES : size;
+    memcpy(bytes, self->digits, count);
+    memset(bytes + count, 0, size - count);
+    return;
+  }
+
+  // the two's complement of -x is ~x + 1
+  OnyxDigit carry = 1;
+  OnyxDigit digit = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    if (i % ONYX_DIGIT_BYTES == 0) {
+      digit = onyxNaturalGet(self, i / ONYX_DIGIT_BYTES);
+
+      if (negative) {
+        digit = ~digit + carry;
+        carry = (carry != 0 && digit == 0);
+      }
+    }
+
+    bytes[big_endian ? size - 1 - i : i] = (uint8_t) (digit >> (8 * (i % ONYX_DIGIT_BYTES)));
+  }
+}
+
+static ptrdiff_t onyxVarintWrite(uint8_t *bytes, uint64_t value) {
+  ptrdiff_t count = 0;
+
+  while (value >= 0x80) {
+    bytes[count++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+
+  bytes[count++] = (uint8_t) value;
+  return count;
+}
+
+// returns the number of bytes read, 0 if the varint is truncated or too large
+static ptrdiff_t onyxVarintRead(const uint8_t *bytes, ptrdiff_t size, uint64_t *value) {
+  uint64_t result = 0;
+
+  for (ptrdiff_t i = 0; i < size && i < 10; ++i) {
+    const uint64_t part = bytes[i] & 0x7F;
+
+    if (i == 9 && part > 1) {
+      return 0;
+    }
+
+    result |= part << (7 * i);
+
+    if ((bytes[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+// size of the packed encoding of self
+static ptrdiff_t onyxIntegerPackedSize(const OnyxInteger *self) {
+  uint8_t header[10];
+  const ptrdiff_t size = (onyxNaturalBitLength(self) + 7) / 8;
+  return onyxVarintWrite(header, (uint64_t) size << 1) + size;
+}
+
+// writes the packed encoding of self, returns the number of bytes written
+static ptrdiff_t onyxIntegerPack(const OnyxInteger *self, uint8_t *bytes) {
+  const ptrdiff_t size = (onyxNaturalBitLength(self) + 7) / 8;
+  const bool negative = onyxIntegerCmpZero(self) < 0;
+  const ptrdiff_t header = onyxVarintWrite(bytes, ((uint64_t) size << 1) | negative);
+
+  OnyxInteger magnitude = *self;
+  magnitude.positive = true;
+  onyxIntegerToBytes(&magnitude, bytes + header, size, false);
+  return header + size;
+}
+
+// reads a packed value, returns the number of bytes read, 0 if the encoding is not valid
+static ptrdiff_t onyxIntegerUnpack(OnyxInteger *self, const uint8_t *bytes, ptrdiff_t size, AgateVM *vm) {
+  uint64_t header;
+  const ptrdiff_t header_size = onyxVarintRead(bytes, size, &header);
+
+  if (header_size == 0 || (header >> 1) > (uint64_t) (size - header_size)) {
+    return 0;
+  }
+
+  const ptrdiff_t value_size = (ptrdiff_t) (header >> 1);
+  onyxIntegerFromBytes(self, bytes + header_size, value_size, false, false, vm);
+  self->positive = (header & 1) == 0 || onyxNaturalCmpZero(self) == 0;
+  return header_size + value_size;
+}
+
+/*
+ * Algorithms - Combinatorics
+ *
+ * The factorial and the binomial coefficients are computed from their prime
+ * factorization: the exponent of each prime is given by Legendre's formula.
+ * The primes are then grouped by the bits of their exponent, so that the
+ * result is p_k^2 * ... with p_k the product of the primes whose exponent has
+ * the bit k set. The power of two is a final shift. Each group is a balanced
+ * product tree on the primes packed in digits.
+ */
+
+// *primes = the primes up to n in increasing order, returns their count, the array must be released
+static ptrdiff_t onyxSieve(uint32_t **primes, uint32_t n, AgateVM *vm) {
+  if (n < 2) {
+    *primes = NULL;
+    return 0;
+  }
+
+  // composite[i] for the odd number 2 * i + 1
+  const uint32_t odd_count = n / 2 + 1;
+  uint8_t *composite = onyxMemoryAllocate(vm, NULL, odd_count);
+  memset(composite, 0, odd_count);
+  ptrdiff_t count = 1;
+
+  for (uint32_t i = 1; i < odd_count && 2 * i + 1 <= n; ++i) {
+    if (composite[i]) {
+      continue;
+    }
+
+    ++count;
+    const uint64_t p = 2 * i + 1;
+
+    for (uint64_t j = p * p / 2; j < odd_count; j += p) {
+      composite[j] = 1;
+    }
+  }
+
+  *primes = onyxMemoryAllocate(vm, NULL, count * sizeof(uint32_t));
+  (*primes)[0] = 2;
+  count = 1;
+
+  for (uint32_t i = 1; i < odd_count && 2 * i + 1 <= n; ++i) {
+    if (!composite[i]) {
+      (*primes)[count++] = 2 * i + 1;
+    }
+  }
+
+  onyxMemoryAllocate(vm, composite, 0);
+  return count;
+}
+
+// self = factors[0] * ... * factors[count - 1]
+static void onyxNaturalProductOfShorts(OnyxInteger *self, const uint32_t *factors, ptrdiff_t count, AgateVM *vm) {
+  // the factors are allocated once as an integer may point to its own small digits
+  OnyxInteger *packed = onyxMemoryAllocate(vm, NULL, (count + 1) * sizeof(OnyxInteger));
+  ptrdiff_t packed_count = 0;
+
+  OnyxDigit digit = 1;
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    OnyxDoubleDigit product = (OnyxDoubleDigit) digit * factors[i];
+
+    if (product <= ONYX_DIGIT_MAX) {
+      digit = (OnyxDigit) product;
+      continue;
+    }
+
+    OnyxInteger *factor = &packed[packed_count++];
+    onyxIntegerCreateEmpty(factor);
+    factor->digits[0] = digit;
+    factor->size = 1;
+    digit = factors[i];
+  }
+
+  OnyxInteger *factor = &packed[packed_count++];
+  onyxIntegerCreateEmpty(factor);
+  factor->digits[0] = digit;
+  factor->size = 1;
+
+  onyxIntegerProductTree(packed, packed_count, vm);
+  onyxIntegerMove(self, &packed[0], vm);
+  onyxMemoryAllocate(vm, packed, 0);
+}
+
+// self = product of primes[i]^exponents[i], primes[0] may be 2
+static void onyxNaturalPrimePowers(OnyxInteger *self, const uint32_t *primes, const uint32_t *exponents, ptrdiff_t count, AgateVM *vm) {
+  uint64_t two_exponent = 0;
+
+  if (count > 0 && primes[0] == 2) {
+    two_exponent = exponents[0];
+    ++primes;
+    ++exponents;
+    --count;
+  }
+
+  uint32_t max_exponent = 0;
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    max_exponent |= exponents[i];
+  }
+
+  onyxIntegerFromInt(self, 1, vm);
+
+  if (max_exponent != 0) {
+    uint32_t *group = onyxMemoryAllocate(vm, NULL, count * sizeof(uint32_t));
+    OnyxInteger product;
+    onyxIntegerCreateEmpty(&product);
+
+    unsigned bit = 31;
+
+    while ((max_exponent & ((uint32_t) 1 << bit)) == 0) {
+      --bit;
+    }
+
+    for (;;) {
+      ptrdiff_t group_count = 0;
+
+      for (ptrdiff_t i = 0; i < count; ++i) {
+        if ((exponents[i] >> bit) & 1) {
+          group[group_count++] = primes[i];
+        }
+      }
+
+      if (group_count > 0) {
+        onyxNaturalProductOfShorts(&product, group, group_count, vm);
+        onyxIntegerMul(self, self, &product, vm);
+      }
+
+      if (bit == 0) {
+        break;
+      }
+
+      --bit;
+      onyxIntegerMul(self, self, self, vm);
+    }
+
+    onyxIntegerDestroy(&product, vm);
+    onyxMemoryAllocate(vm, group, 0);
+  }
+
+  onyxIntegerShiftLeft(self, self, two_exponent, vm);
+}
+
+// exponent of p in n!
+static uint32_t onyxLegendre(uint32_t n, uint32_t p) {
+  uint32_t exponent = 0;
+
+  while (n >= p) {
+    n /= p;
+    exponent += n;
+  }
+
+  return exponent;
+}
+
+// self = n!
+static void onyxIntegerFactorial(OnyxInteger *self, uint32_t n, AgateVM *vm) {
+  if (n < 2) {
+    onyxIntegerFromInt(self, 1, vm);
+    return;
+  }
+
+  uint32_t *primes;
+  ptrdiff_t count = onyxSieve(&primes, n, vm);
+  uint32_t *exponents = onyxMemoryAllocate(vm, NULL, count * sizeof(uint32_t));
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    exponents[i] = onyxLegendre(n, primes[i]);
+  }
+
+  onyxNaturalPrimePowers(self, primes, exponents, count, vm);
+
+  onyxMemoryAllocate(vm, exponents, 0);
+  onyxMemoryAllocate(vm, primes, 0);
+}
+
+// self = n! / (k! (n - k)!), k <= n
+static void onyxIntegerBinomial(OnyxInteger *self, uint32_t n, uint32_t k, AgateVM *vm) {
+  assert(k <= n);
+
+  if (n - k < k) {
+    k = n - k;
+  }
+
+  if (k == 0) {
+    onyxIntegerFromInt(self, 1, vm);
+    return;
+  }
+
+  if (k <= n / ONYX_BINOMIAL_FALLING_RATIO) {
+    // (n - k + 1) * ... * n / k!
+    uint32_t *factors = onyxMemoryAllocate(vm, NULL, k * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < k; ++i) {
+      factors[i] = n - i;
+    }
+
+    OnyxInteger falling;
+    onyxIntegerCreateEmpty(&falling);
+    onyxNaturalProductOfShorts(&falling, factors, k, vm);
+    onyxMemoryAllocate(vm, factors, 0);
+
+    OnyxInteger factorial;
+    onyxIntegerCreateEmpty(&factorial);
+    onyxIntegerFactorial(&factorial, k, vm);
+
+    OnyxInteger rem;
+    onyxIntegerCreateEmpty(&rem);
+    onyxNaturalDiv(self, &rem, &falling, &factorial, vm);
+    assert(onyxNaturalCmpZero(&rem) == 0);
+    self->positive = true;
+
+    onyxIntegerDestroy(&rem, vm);
+    onyxIntegerDestroy(&factorial, vm);
+    onyxIntegerDestroy(&falling, vm);
+    return;
+  }
+
+  uint32_t *primes;
+  ptrdiff_t count = onyxSieve(&primes, n, vm);
+  uint32_t *exponents = onyxMemoryAllocate(vm, NULL, count * sizeof(uint32_t));
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    exponents[i] = onyxLegendre(n, primes[i]) - onyxLegendre(k, primes[i]) - onyxLegendre(n - k, primes[i]);
+  }
+
+  onyxNaturalPrimePowers(self, primes, exponents, count, vm);
+
+  onyxMemoryAllocate(vm, exponents, 0);
+  onyxMemoryAllocate(vm, primes, 0);
+}
+
+// self = product of the primes up to n
+static void onyxIntegerPrimorial(OnyxInteger *self, uint32_t n, AgateVM *vm) {
+  uint32_t *primes;
+  ptrdiff_t count = onyxSieve(&primes, n, vm);
+
+  onyxNaturalProductOfShorts(self, primes, count, vm);
+  self->positive = true;
+
+  onyxMemoryAllocate(vm, primes, 0);
+}
+
+/*
+ * Algorithms - Greatest common divisor
+ *
+ * Lehmer's algorithm (Knuth, TAOCP vol. 2, 4.5.2, Algorithm L): the leading
+ * bits of both operands are enough to compute several steps of Euclid's
+ * algorithm in single precision, the resulting cosequences are then applied
+ * to the full operands at once. When the leading bits do not determine any
+ * quotient, a full division step is done.
+ */
+
+// leading bits used by Lehmer's algorithm, so that the cosequences fit in a digit and an int64_t
+#define ONYX_GCD_BITS (ONYX_DIGIT_BITS - 2)
+
+// bits [offset, offset + count) of self, count <= 62
+static uint64_t onyxNaturalBits(const OnyxInteger *self, ptrdiff_t offset, int count) {
+  uint64_t result = 0;
+  ptrdiff_t index = offset / ONYX_DIGIT_BITS;
+  unsigned shift = offset % ONYX_DIGIT_BITS;
+
+  for (int done = 0; done < count; done += ONYX_DIGIT_BITS - shift, shift = 0) {
+    result |= (uint64_t) (onyxNaturalGet(self, index++) >> shift) << done;
+  }
+
+  return result & ((UINT64_C(1) << count) - 1);
+}
+
+// result[0..size) = lhs * a - rhs * b, the result must be non-negative and fit in size digits
+static void onyxDigitsMulSubMul(OnyxDigit *result, const OnyxDigit *lhs, OnyxDigit a, const OnyxDigit *rhs, OnyxDigit b, ptrdiff_t size) {
+  OnyxDoubleDigit lhs_carry = 0;
+  OnyxDoubleDigit rhs_carry = 0;
+  OnyxDigit borrow = 0;
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    OnyxDoubleDigit l = (OnyxDoubleDigit) lhs[i] * a + lhs_carry;
+    OnyxDoubleDigit r = (OnyxDoubleDigit) rhs[i] * b + rhs_carry;
+    lhs_carry = l >> ONYX_DIGIT_BITS;
+    rhs_carry = r >> ONYX_DIGIT_BITS;
+
+    OnyxDigit ld = l;
+    OnyxDigit rd = r;
+    OnyxDigit diff = ld - rd;
+    result[i] = diff - borrow;
+    borrow = (ld < rd) || (diff < borrow);
+  }
+
+  assert(lhs_carry == rhs_carry + borrow);
+}
+
+// self = x * a + y * b, tmp is a temporary
+static void onyxIntegerMulAddMul(OnyxInteger *self, const OnyxInteger *x, int64_t a, const OnyxInteger *y, int64_t b, OnyxInteger *tmp, AgateVM *vm) {
+  onyxIntegerMulShort(self, x, (OnyxDigit) (a < 0 ? -a : a), a >= 0, vm);
+  onyxIntegerMulShort(tmp, y, (OnyxDigit) (b < 0 ? -b : b), b >= 0, vm);
+  onyxIntegerAdd(self, self, tmp, vm);
+}
+
+// Lehmer's single precision steps on the leading bits of u and v, u >= v,
+// returns false if no quotient could be determined
+static bool onyxNaturalGcdLehmer(const OnyxInteger *u, const OnyxInteger *v, int64_t cosequence[4]) {
+  const ptrdiff_t bits = onyxNaturalBitLength(u);
+  const ptrdiff_t offset = bits > ONYX_GCD_BITS ? bits - ONYX_GCD_BITS : 0;
+
+  int64_t x = onyxNaturalBits(u, offset, ONYX_GCD_BITS);
+  int64_t y = onyxNaturalBits(v, offset, ONYX_GCD_BITS);
+  int64_t a = 1, b = 0, c = 0, d = 1;
+
+  while (y + c != 0 && y + d != 0) {
+    int64_t q = (x + a) / (y + c);
+
+    if (q != (x + b) / (y + d)) {
+      break;
+    }
+
+    int64_t t = a - q * c;
+    a = c;
+    c = t;
+
+    t = b - q * d;
+    b = d;
+    d = t;
+
+    t = x - q * y;
+    x = y;
+    y = t;
+  }
+
+  cosequence[0] = a;
+  cosequence[1] = b;
+  cosequence[2] = c;
+  cosequence[3] = d;
+  return b != 0;
+}
+
+// gcd = s * lhs + t * rhs with gcd >= 0, s and t may be NULL
+static void onyxIntegerGcdExt(OnyxInteger *gcd, OnyxInteger *s, OnyxInteger *t, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  // gcd, s and t may alias lhs or rhs
+  const uint64_t stats_start = onyxStatsEnter();
+  const ptrdiff_t stats_size = onyxSizeMax(lhs->size, rhs->size);
+
+  // u = s0 * |lhs| (mod |rhs|) and v = s1 * |lhs| (mod |rhs|)
+  OnyxInteger naturals[4];
+  OnyxInteger cofactors[5];
+
+  for (ptrdiff_t i = 0; i < 4; ++i) {
+    onyxIntegerCreateEmpty(&naturals[i]);
+  }
+
+  for (ptrdiff_t i = 0; i < 5; ++i) {
+    onyxIntegerCreateEmpty(&cofactors[i]);
+  }
+
+  const bool extended = (s != NULL || t != NULL);
+
+  OnyxInteger *u = &naturals[0];
+  OnyxInteger *v = &naturals[1];
+  OnyxInteger *u_next = &naturals[2];
+  OnyxInteger *v_next = &naturals[3];
+  OnyxInteger *s0 = &cofactors[0];
+  OnyxInteger *s1 = &cofactors[1];
+  OnyxInteger *s0_next = &cofactors[2];
+  OnyxInteger *s1_next = &cofactors[3];
+  OnyxInteger *tmp = &cofactors[4];
+  OnyxInteger *swap;
+
+  onyxNaturalCopy(u, lhs, vm);
+  onyxNaturalCopy(v, rhs, vm);
+  onyxIntegerFromInt(s0, 1, vm);
+  onyxIntegerFromInt(s1, 0, vm);
+
+  if (onyxNaturalCmp(u, v) < 0) {
+    swap = u; u = v; v = swap;
+    swap = s0; s0 = s1; s1 = swap;
+  }
+
+  while (onyxNaturalCmpZero(v) != 0) {
+    int64_t cosequence[4];
+
+    if (onyxNaturalGcdLehmer(u, v, cosequence)) {
+      const int64_t a = cosequence[0], b = cosequence[1], c = cosequence[2], d = cosequence[3];
+      const ptrdiff_t size = u->size;
+      onyxNaturalEnsureCapacity(v, size, vm);
+      memset(v->digits + v->size, 0, (size - v->size) * sizeof(OnyxDigit));
+
+      onyxNaturalEnsureCapacity(u_next, size, vm);
+      onyxNaturalEnsureCapacity(v_next, size, vm);
+
+      // the signs alternate: a, d and b, c have opposite signs
+      if (b < 0) {
+        onyxDigitsMulSubMul(u_next->digits, u->digits, a, v->digits, -b, size);
+        onyxDigitsMulSubMul(v_next->digits, v->digits, d, u->digits, -c, size);
+      } else {
+        onyxDigitsMulSubMul(u_next->digits, v->digits, b, u->digits, -a, size);
+        onyxDigitsMulSubMul(v_next->digits, u->digits, c, v->digits, -d, size);
+      }
+
+      u_next->size = v_next->size = size;
+      onyxNaturalNormalize(u_next);
+      onyxNaturalNormalize(v_next);
+
+      if (extended) {
+        onyxIntegerMulAddMul(s0_next, s0, a, s1, b, tmp, vm);
+        onyxIntegerMulAddMul(s1_next, s0, c, s1, d, tmp, vm);
+      }
+    } else {
+      // u_next = v, v_next = u mod v, s0_next = s1, s1_next = s0 - q * s1
+      onyxNaturalDiv(tmp, v_next, u, v, vm);
+      onyxNaturalCopy(u_next, v, vm);
+
+      if (extended) {
+        tmp->positive = true;
+        onyxIntegerMul(s1_next, tmp, s1, vm);
+        onyxIntegerSub(s1_next, s0, s1_next, vm);
+        onyxIntegerCopy(s0_next, s1, vm);
+      }
+    }
+
+    swap = u; u = u_next; u_next = swap;
+    swap = v; v = v_next; v_next = swap;
+    swap = s0; s0 = s0_next; s0_next = swap;
+    swap = s1; s1 = s1_next; s1_next = swap;
+  }
+
+  if (extended) {
+    // s = s0 * sign(lhs) and t = (gcd - s * lhs) / rhs
+    if (!lhs->positive) {
+      s0->positive = !s0->positive || onyxNaturalCmpZero(s0) == 0;
+    }
+
+    if (t != NULL) {
+      if (onyxIntegerCmpZero(rhs) == 0) {
+        onyxIntegerFromInt(t, 0, vm);
+      } else {
+        u->positive = true;
+        onyxIntegerMul(tmp, s0, lhs, vm);
+        onyxIntegerSub(tmp, u, tmp, vm);
+        OnyxInteger *rem = v;
+        onyxIntegerDiv(t, rem, tmp, rhs, vm);
+        assert(onyxIntegerCmpZero(rem) == 0);
+      }
+    }
+
+    if (s != NULL) {
+      onyxIntegerCopy(s, s0, vm);
+    }
+  }
+
+  onyxNaturalCopy(gcd, u, vm);
+  gcd->positive = true;
+
+  for (ptrdiff_t i = 0; i < 4; ++i) {
+    onyxIntegerDestroy(&naturals[i], vm);
+  }
+
+  for (ptrdiff_t i = 0; i < 5; ++i) {
+    onyxIntegerDestroy(&cofactors[i], vm);
+  }
+
+  onyxStatsLeave(stats_start, ONYX_STATS_GCD, stats_size);
+}
+
+// self = value^-1 mod modulus in [0, modulus), returns false if there is no inverse
+static bool onyxIntegerModInv(OnyxInteger *self, const OnyxInteger *value, const OnyxInteger *modulus, AgateVM *vm) {
+  assert(onyxIntegerCmpZero(modulus) > 0);
+
+  OnyxInteger gcd;
+  onyxIntegerCreateEmpty(&gcd);
+
+  OnyxInteger s;
+  onyxIntegerCreateEmpty(&s);
+
+  onyxIntegerGcdExt(&gcd, &s, NULL, value, modulus, vm);
+  bool invertible = (onyxNaturalCmpShort(&gcd, 1) == 0);
+
+  if (invertible) {
+    OnyxInteger quo;
+    onyxIntegerCreateEmpty(&quo);
+    onyxIntegerDiv(&quo, self, &s, modulus, vm);
+    onyxIntegerDestroy(&quo, vm);
+  }
+
+  onyxIntegerDestroy(&gcd, vm);
+  onyxIntegerDestroy(&s, vm);
+  return invertible;
+}
+
+/*
+ * Algorithms - Rational
+ *
+ * A rational is not reduced after each operation. The gcd of the numerator
+ * and the denominator is computed when the rational is observed, or when its
+ * size has grown past twice its size at the last reduction. The products
+ * cancel the common factors crosswise, as gcd(a, d) and gcd(c, b) for
+ * a/b * c/d, so that the product of reduced rationals is reduced.
+ */
+
+typedef struct {
+  OnyxInteger num; // carries the sign
+  OnyxInteger den; // positive, empty if the rational is not valid
+  ptrdiff_t base_size; // size of the operands at their last reduction
+  bool reduced;
+} OnyxRational;
+
+static void onyxRationalCreate(OnyxRational *self, AgateVM *vm) {
+  onyxIntegerCreateEmpty(&self->num);
+  onyxIntegerCreateEmpty(&self->den);
+  onyxIntegerFromInt(&self->num, 0, vm);
+  onyxIntegerFromInt(&self->den, 1, vm);
+  self->base_size = 2;
+  self->reduced = true;
+}
+
+static void onyxRationalDestroy(OnyxRational *self, AgateVM *vm) {
+  onyxIntegerDestroy(&self->num, vm);
+  onyxIntegerDestroy(&self->den, vm);
+}
+
+static void onyxRationalMove(OnyxRational *self, OnyxRational *other, AgateVM *vm) {
+  assert(self != other);
+  onyxIntegerMove(&self->num, &other->num, vm);
+  onyxIntegerMove(&self->den, &other->den, vm);
+  self->base_size = other->base_size;
+  self->reduced = other->reduced;
+}
+
+static inline ptrdiff_t onyxRationalSize(const OnyxRational *self) {
+  return self->num.size + self->den.size;
+}
+
+static inline bool onyxNaturalIsOne(const OnyxInteger *self) {
+  return onyxNaturalCmpShort(self, 1) == 0;
+}
+
+// self = value / divisor, the division must be exact
+static void onyxIntegerDivExact(OnyxInteger *self, const OnyxInteger *value, const OnyxInteger *divisor, AgateVM *vm) {
+  OnyxInteger quo;
+  onyxIntegerCreateEmpty(&quo);
+  OnyxInteger rem;
+  onyxIntegerCreateEmpty(&rem);
+
+  onyxNaturalDiv(&quo, &rem, value, divisor, vm);
+  assert(onyxNaturalCmpZero(&rem) == 0);
+  quo.positive = (value->positive == divisor->positive) || onyxNaturalCmpZero(&quo) == 0;
+  onyxIntegerMove(self, &quo, vm);
+
+  onyxIntegerDestroy(&rem, vm);
+}
+
+static void onyxRationalReduce(OnyxRational *self, AgateVM *vm) {
+  if (!self->reduced) {
+    OnyxInteger gcd;
+    onyxIntegerCreateEmpty(&gcd);
+    onyxIntegerGcdExt(&gcd, NULL, NULL, &self->num, &self->den, vm);
+
+    if (!onyxNaturalIsOne(&gcd)) {
+      onyxIntegerDivExact(&self->num, &self->num, &gcd, vm);
+      onyxIntegerDivExact(&self->den, &self->den, &gcd, vm);
+    }
+
+    onyxIntegerDestroy(&gcd, vm);
+    self->reduced = true;
+  }
+
+  self->base_size = onyxRationalSize(self);
+}
+
+// called on the result of an operation, base_size is the one of the operands
+static void onyxRationalUpdate(OnyxRational *self, ptrdiff_t base_size, AgateVM *vm) {
+  if (onyxNaturalCmpZero(&self->num) == 0) {
+    self->num.positive = true;
+    onyxIntegerFromInt(&self->den, 1, vm);
+    self->reduced = true;
+  } else if (onyxNaturalIsOne(&self->den)) {
+    self->reduced = true;
+  }
+
+  if (self->reduced) {
+    self->base_size = onyxRationalSize(self);
+    return;
+  }
+
+  self->base_size = base_size;
+
+  if (onyxRationalSize(self) > 2 * base_size + ONYX_RATIONAL_REDUCE_THRESHOLD) {
+    onyxRationalReduce(self, vm);
+  }
+}
+
+// self = lhs + rhs, or lhs - rhs if subtract is true, self may alias lhs or rhs
+static void onyxRationalAdd(OnyxRational *self, const OnyxRational *lhs, const OnyxRational *rhs, bool subtract, AgateVM *vm) {
+  OnyxRational result;
+  onyxRationalCreate(&result, vm);
+
+  OnyxInteger rhs_num = rhs->num;
+
+  if (subtract) {
+    rhs_num.positive = !rhs_num.positive;
+  }
+
+  if (onyxNaturalCmp(&lhs->den, &rhs->den) == 0) {
+    // a/b + c/b = (a + c)/b
+    onyxIntegerAdd(&result.num, &lhs->num, &rhs_num, vm);
+    onyxNaturalCopy(&result.den, &lhs->den, vm);
+    result.reduced = false;
+  } else if (onyxNaturalIsOne(&lhs->den)) {
+    // a + c/d = (a * d + c)/d, reduced if c/d is reduced
+    onyxIntegerMul(&result.num, &lhs->num, &rhs->den, vm);
+    onyxIntegerAdd(&result.num, &result.num, &rhs_num, vm);
+    onyxNaturalCopy(&result.den, &rhs->den, vm);
+    result.reduced = rhs->reduced;
+  } else if (onyxNaturalIsOne(&rhs->den)) {
+    // a/b + c = (a + c * b)/b, reduced if a/b is reduced
+    onyxIntegerMul(&result.num, &rhs_num, &lhs->den, vm);
+    onyxIntegerAdd(&result.num, &result.num, &lhs->num, vm);
+    onyxNaturalCopy(&result.den, &lhs->den, vm);
+    result.reduced = lhs->reduced;
+  } else {
+    // a/b + c/d = (a * d + c * b)/(b * d)
+    onyxIntegerMul(&result.num, &lhs->num, &rhs->den, vm);
+    onyxIntegerAddMul(&result.num, &rhs_num, &lhs->den, vm);
+    onyxIntegerMul(&result.den, &lhs->den, &rhs->den, vm);
+    result.reduced = false;
+  }
+
+  onyxRationalUpdate(&result, onyxSizeMax(lhs->base_size, rhs->base_size), vm);
+  onyxRationalMove(self, &result, vm);
+  onyxRationalDestroy(&result, vm);
+}
+
+// factor = factor / gcd(factor, other) and other = other / gcd(factor, other)
+static void onyxRationalCancel(OnyxInteger *factor, OnyxInteger *other, AgateVM *vm) {
+  if (onyxNaturalIsOne(factor) || onyxNaturalIsOne(other)) {
+    return;
+  }
+
+  OnyxInteger gcd;
+  onyxIntegerCreateEmpty(&gcd);
+  onyxIntegerGcdExt(&gcd, NULL, NULL, factor, other, vm);
+
+  if (!onyxNaturalIsOne(&gcd)) {
+    onyxIntegerDivExact(factor, factor, &gcd, vm);
+    onyxIntegerDivExact(other, other, &gcd, vm);
+  }
+
+  onyxIntegerDestroy(&gcd, vm);
+}
+
+// self = lhs * rhs, or lhs / rhs if divide is true, self may alias lhs or rhs
+static bool onyxRationalMul(OnyxRational *self, const OnyxRational *lhs, const OnyxRational *rhs, bool divide, AgateVM *vm) {
+  if (divide && onyxNaturalCmpZero(&rhs->num) == 0) {
+    return false;
+  }
+
+  // a/b * c/d
+  OnyxInteger factors[4];
+
+  for (ptrdiff_t i = 0; i < 4; ++i) {
+    onyxIntegerCreateEmpty(&factors[i]);
+  }
+
+  OnyxInteger *a = &factors[0];
+  OnyxInteger *b = &factors[1];
+  OnyxInteger *c = &factors[2];
+  OnyxInteger *d = &factors[3];
+
+  onyxIntegerCopy(a, &lhs->num, vm);
+  onyxIntegerCopy(b, &lhs->den, vm);
+  onyxIntegerCopy(divide ? d : c, &rhs->num, vm);
+  onyxIntegerCopy(divide ? c : d, &rhs->den, vm);
+
+  // the sign is carried by the numerator
+  c->positive = (c->positive == d->positive);
+  d->positive = true;
+
+  const bool reduced = lhs->reduced && rhs->reduced;
+
+  if (reduced) {
+    onyxRationalCancel(a, d, vm);
+    onyxRationalCancel(c, b, vm);
+  }
+
+  OnyxRational result;
+  onyxRationalCreate(&result, vm);
+  onyxIntegerMul(&result.num, a, c, vm);
+  onyxIntegerMul(&result.den, b, d, vm);
+  result.reduced = reduced;
+
+  onyxRationalUpdate(&result, onyxSizeMax(lhs->base_size, rhs->base_size), vm);
+  onyxRationalMove(self, &result, vm);
+  onyxRationalDestroy(&result, vm);
+
+  for (ptrdiff_t i = 0; i < 4; ++i) {
+    onyxIntegerDestroy(&factors[i], vm);
+  }
+
+  return true;
+}
+
+static int onyxRationalCmp(const OnyxRational *lhs, const OnyxRational *rhs, AgateVM *vm) {
+  const int lhs_sign = onyxIntegerCmpZero(&lhs->num);
+  const int rhs_sign = onyxIntegerCmpZero(&rhs->num);
+
+  if (lhs_sign != rhs_sign) {
+    return lhs_sign < rhs_sign ? -1 : 1;
+  }
+
+  if (onyxNaturalCmp(&lhs->den, &rhs->den) == 0) {
+    return onyxIntegerCmp(&lhs->num, &rhs->num);
+  }
+
+  // a/b <=> c/d is a * d <=> c * b
+  OnyxInteger lhs_cross;
+  onyxIntegerCreateEmpty(&lhs_cross);
+  onyxIntegerMul(&lhs_cross, &lhs->num, &rhs->den, vm);
+
+  OnyxInteger rhs_cross;
+  onyxIntegerCreateEmpty(&rhs_cross);
+  onyxIntegerMul(&rhs_cross, &rhs->num, &lhs->den, vm);
+
+  int cmp = onyxIntegerCmp(&lhs_cross, &rhs_cross);
+
+  onyxIntegerDestroy(&lhs_cross, vm);
+  onyxIntegerDestroy(&rhs_cross, vm);
+  return cmp;
+}
+
+// nearest double, the quotient is computed with two more bits than the
+// mantissa and a sticky bit so that the conversion of normal values rounds
+// correctly
+static double onyxRationalToDouble(const OnyxRational *self, AgateVM *vm) {
+  if (onyxNaturalCmpZero(&self->num) == 0) {
+    return 0.0;
+  }
+
+  const ptrdiff_t shift = 55 - (onyxNaturalBitLength(&self->num) - onyxNaturalBitLength(&self->den));
+
+  OnyxInteger num;
+  onyxIntegerCreateEmpty(&num);
+  OnyxInteger den;
+  onyxIntegerCreateEmpty(&den);
+
+  if (shift >= 0) {
+    onyxIntegerShiftLeft(&num, &self->num, shift, vm);
+    onyxNaturalCopy(&den, &self->den, vm);
+  } else {
+    onyxNaturalCopy(&num, &self->num, vm);
+    onyxIntegerShiftLeft(&den, &self->den, -shift, vm);
+  }
+
+  OnyxInteger quo;
+  onyxIntegerCreateEmpty(&quo);
+  OnyxInteger rem;
+  onyxIntegerCreateEmpty(&rem);
+  onyxNaturalDiv(&quo, &rem, &num, &den, vm);
+
+  // the quotient has 55 or 56 bits
+  uint64_t mantissa = 0;
+
+  for (ptrdiff_t i = quo.size - 1; i >= 0; --i) {
+    mantissa = (uint64_t) (((OnyxDoubleDigit) mantissa << ONYX_DIGIT_BITS) | quo.digits[i]);
+  }
+
+  if (onyxNaturalCmpZero(&rem) != 0) {
+    mantissa |= 1;
+  }
+
+  onyxIntegerDestroy(&num, vm);
+  onyxIntegerDestroy(&den, vm);
+  onyxIntegerDestroy(&quo, vm);
+  onyxIntegerDestroy(&rem, vm);
+
+  // beyond the range of the doubles, ldexp gives 0 or infinity
+  ptrdiff_t exponent = -shift;
+
+  if (exponent < -4096) {
+    exponent = -4096;
+  } else if (exponent > 4096) {
+    exponent = 4096;
+  }
+
+  double result = ldexp((double) mantissa, (int) exponent);
+  return self->num.positive ? result : -result;
+}
+
+/*
+ * Algorithms - Roots
+ *
+ * Newton's iteration x' = ((k - 1) * x + n / x^(k - 1)) / k decreases
+ * towards floor(n^(1/k)) when started from above. The initial estimate is
+ * the root of the leading half of the bits, computed recursively, and in
+ * floating point at the bottom of the recursion, so that one or two
+ * iterations are enough at each level.
+ */
+
+// quadratic residues modulo 256, 63, 65, 11 and 17, as bitsets
+static const uint64_t onyxSquares256[4] = { UINT64_C(0x0202021202030213), UINT64_C(0x0202021202020213), UINT64_C(0x0202021202030212), UINT64_C(0x0202021202020212) };
+static const uint64_t onyxSquares63[1] = { UINT64_C(0x0402483012450293) };
+static const uint64_t onyxSquares65[2] = { UINT64_C(0x218A019866014613), UINT64_C(0x0000000000000001) };
+static const uint64_t onyxSquares11[1] = { UINT64_C(0x000000000000023B) };
+static const uint64_t onyxSquares17[1] = { UINT64_C(0x000000000001A317) };
+
+static inline bool onyxSquaresContains(const uint64_t *squares, OnyxDigit residue) {
+  return (squares[residue / 64] >> (residue % 64)) & 1;
+}
+
+static void onyxNaturalRoot(OnyxInteger *self, const OnyxInteger *value, ptrdiff_t k, AgateVM *vm);
+
+// estimate >= floor(value^(1/k)), with about half of its bits correct
+static void onyxNaturalRootEstimate(OnyxInteger *estimate, const OnyxInteger *value, ptrdiff_t k, AgateVM *vm) {
+  const ptrdiff_t bits = onyxNaturalBitLength(value);
+
+  if (bits / k > 64) {
+    // if r = floor((value / 2^(k*s))^(1/k)), then value^(1/k) < (r + 1) * 2^s
+    const ptrdiff_t shift = bits / k / 2;
+
+    OnyxInteger high;
+    onyxIntegerCreateEmpty(&high);
+    onyxIntegerShiftRight(&high, value, k * shift, vm);
+    onyxNaturalRoot(estimate, &high, k, vm);
+    onyxIntegerDestroy(&high, vm);
+
+    onyxNaturalAddShort(estimate, estimate, 1, vm);
+    onyxIntegerShiftLeft(estimate, estimate, shift, vm);
+    return;
+  }
+
+  // value < (top + 1) * 2^shift with top on at most 52 bits, hence exact in a double
+  ptrdiff_t shift = bits > 52 ? bits - 52 : 0;
+  shift += (k - shift % k) % k;
+  const double top = (double) onyxNaturalBits(value, shift, 52);
+  const double root = (k == 2) ? sqrt(top + 1.0) : pow(top + 1.0, 1.0 / k);
+
+  onyxIntegerFromInt(estimate, (int64_t) (root * (1.0 + 1e-9)) + 1, vm);
+  onyxIntegerShiftLeft(estimate, estimate, shift / k, vm);
+}
+
+// self = floor(value^(1/k)), k >= 2, self may alias value
+static void onyxNaturalRoot(OnyxInteger *self, const OnyxInteger *value, ptrdiff_t k, AgateVM *vm) {
+  assert(k >= 2);
+  const uint64_t stats_start = onyxStatsEnter();
+  const ptrdiff_t stats_size = value->size;
+  const ptrdiff_t bits = onyxNaturalBitLength(value);
+
+  if (bits <= k) {
+    // value < 2^k so the root is 0 or 1
+    const bool zero = (bits == 0);
+    onyxNaturalEnsureCapacity(self, 1, vm);
+    self->digits[0] = zero ? 0 : 1;
+    self->size = 1;
+    onyxStatsLeave(stats_start, ONYX_STATS_ROOT, stats_size);
+    return;
+  }
+
+  assert((OnyxDoubleDigit) k - 1 <= ONYX_DIGIT_MAX);
+
+  OnyxInteger integers[5];
+
+  for (ptrdiff_t i = 0; i < 5; ++i) {
+    onyxIntegerCreateEmpty(&integers[i]);
+  }
+
+  OnyxInteger *x = &integers[0];
+  OnyxInteger *next = &integers[1];
+  OnyxInteger *power = &integers[2];
+  OnyxInteger *quo = &integers[3];
+  OnyxInteger *rem = &integers[4];
+  OnyxInteger *swap;
+
+  onyxNaturalRootEstimate(x, value, k, vm);
+
+  // the buffers only shrink from here, they are allocated once
+  const ptrdiff_t capacity = value->size + 1;
+  onyxNaturalEnsureCapacity(next, capacity, vm);
+  onyxNaturalEnsureCapacity(quo, capacity, vm);
+  onyxNaturalEnsureCapacity(rem, capacity, vm);
+
+  for (;;) {
+    const OnyxInteger *divisor = x;
+
+    if (k > 2) {
+      onyxNaturalPow(power, x, k - 1, vm);
+      divisor = power;
+    }
+
+    onyxNaturalDiv(quo, rem, value, divisor, vm);
+    onyxNaturalMulShort(next, x, k - 1, vm);
+    onyxNaturalAdd(next, next, quo, vm);
+    onyxNaturalDivShort(next, NULL, next, k, vm);
+
+    if (onyxNaturalCmp(next, x) >= 0) {
+      break;
+    }
+
+    swap = x; x = next; next = swap;
+  }
+
+  onyxNaturalCopy(self, x, vm);
+
+  for (ptrdiff_t i = 0; i < 5; ++i) {
+    onyxIntegerDestroy(&integers[i], vm);
+  }
+
+  onyxStatsLeave(stats_start, ONYX_STATS_ROOT, stats_size);
+}
+
+// self = value^(1/k) rounded towards zero, returns false if the root is not defined
+static bool onyxIntegerRoot(OnyxInteger *self, const OnyxInteger *value, int64_t k, AgateVM *vm) {
+  const bool negative = onyxIntegerCmpZero(value) < 0;
+
+  if (k <= 0 || (negative && k % 2 == 0)) {
+    return false;
+  }
+
+  if (k == 1) {
+    onyxIntegerCopy(self, value, vm);
+    return true;
+  }
+
+  // the root is 0 or 1 when k is at least the size in bits
+  if (k > PTRDIFF_MAX || k > onyxNaturalBitLength(value)) {
+    k = onyxNaturalBitLength(value) + 2;
+  }
+
+  onyxNaturalRoot(self, value, k, vm);
+  self->positive = !negative;
+  return true;
+}
+
+static bool onyxIntegerIsSquare(const OnyxInteger *value, AgateVM *vm) {
+  if (onyxIntegerCmpZero(value) < 0) {
+    return false;
+  }
+
+  // most non-squares are rejected by their residues
+  if (!onyxSquaresContains(onyxSquares256, value->digits[0] % 256)) {
+    return false;
+  }
+
+  const OnyxDigit residue = onyxNaturalModShort(value, 63 * 65 * 11 * 17);
+
+  if (!onyxSquaresContains(onyxSquares63, residue % 63) || !onyxSquaresContains(onyxSquares65, residue % 65) || !onyxSquaresContains(onyxSquares11, residue % 11) || !onyxSquaresContains(onyxSquares17, residue % 17)) {
+    return false;
+  }
+
+  OnyxInteger root;
+  onyxIntegerCreateEmpty(&root);
+  onyxNaturalRoot(&root, value, 2, vm);
+
+  OnyxInteger square;
+  onyxIntegerCreateEmpty(&square);
+  onyxNaturalMul(&square, &root, &root, vm);
+
+  bool result = (onyxNaturalCmp(&square, value) == 0);
+
+  onyxIntegerDestroy(&root, vm);
+  onyxIntegerDestroy(&square, vm);
+  return result;
+}
+
+/*
+ * Algorithms - Modular arithmetic
+ *
+ * A modulus precomputes the constants of the reductions. Products are reduced
+ * with Barrett's method, and exponentiations with odd moduli are computed in
+ * Montgomery form. Residues are stored on exactly the size of the modulus.
+ */
+
+typedef struct {
+  OnyxInteger modulus;
+  OnyxInteger reciprocal; // floor(BASE^(2n) / modulus)
+  OnyxInteger r2; // BASE^(2n) mod modulus, for the Montgomery form
+  OnyxDigit inverse; // -modulus^-1 mod BASE, for the Montgomery form
+  bool montgomery;
+} OnyxModulus;
+
+static void onyxModulusCreate(OnyxModulus *self, const OnyxInteger *modulus, AgateVM *vm) {
+  assert(onyxIntegerCmpZero(modulus) > 0);
+
+  onyxIntegerCreateEmpty(&self->modulus);
+  onyxIntegerCopy(&self->modulus, modulus, vm);
+  const ptrdiff_t n = self->modulus.size;
+
+  OnyxInteger power;
+  onyxIntegerCreateEmpty(&power);
+  onyxNaturalEnsureCapacity(&power, 2 * n + 1, vm);
+  memset(power.digits, 0, 2 * n * sizeof(OnyxDigit));
+  power.digits[2 * n] = 1;
+  power.size = 2 * n + 1;
+
+  onyxIntegerCreateEmpty(&self->reciprocal);
+  onyxIntegerCreateEmpty(&self->r2);
+  onyxNaturalDiv(&self->reciprocal, &self->r2, &power, &self->modulus, vm);
+  onyxIntegerDestroy(&power, vm);
+
+  const OnyxDigit m0 = self->modulus.digits[0];
+  self->montgomery = (m0 & 1) != 0;
+  self->inverse = 0;
+
+  if (self->montgomery) {
+    // Newton iteration, each step doubles the number of correct bits, starting with 3
+    OnyxDigit x = m0;
+
+    for (unsigned bits = 3; bits < ONYX_DIGIT_BITS; bits *= 2) {
+      x *= 2 - m0 * x;
+    }
+
+    assert(x * m0 == 1);
+    self->inverse = -x;
+
+    // residues are stored on n digits
+    onyxNaturalEnsureCapacity(&self->r2, n, vm);
+    memset(self->r2.digits + self->r2.size, 0, (n - self->r2.size) * sizeof(OnyxDigit));
+  }
+}
+
+static void onyxModulusDestroy(OnyxModulus *self, AgateVM *vm) {
+  onyxIntegerDestroy(&self->r2, vm);
+  onyxIntegerDestroy(&self->reciprocal, vm);
+  onyxIntegerDestroy(&self->modulus, vm);
+}
+
+// number of scratch digits needed by onyxModulusMul
+static ptrdiff_t onyxModulusScratch(const OnyxModulus *self) {
+  const ptrdiff_t n = self->modulus.size;
+  const ptrdiff_t k = self->reciprocal.size;
+  return 2 * n + (n + 1 + k) + (k + n) + onyxSizeMax(onyxDigitsMulScratch(n + 1, k), onyxDigitsMulScratch(k, n));
+}
+
+// result[0..n) = product[0..2n) mod modulus, product < modulus^2
+static void onyxModulusReduceBarrett(const OnyxModulus *self, OnyxDigit *result, const OnyxDigit *product, OnyxDigit *scratch) {
+  const ptrdiff_t n = self->modulus.size;
+  const OnyxDigit *m = self->modulus.digits;
+  const ptrdiff_t k = self->reciprocal.size;
+
+  // estimate of the quotient, at most 2 less than the quotient
+  OnyxDigit *q = scratch;
+  OnyxDigit *qm = q + n + 1 + k;
+  OnyxDigit *next = qm + k + n;
+  onyxDigitsMul(q, product + n - 1, n + 1, self->reciprocal.digits, k, next);
+  onyxDigitsMul(qm, q + n + 1, k, m, n, next);
+
+  // the difference fits in n + 1 digits
+  onyxDigitsSub(qm, product, n + 1, qm, n + 1);
+
+  while (qm[n] != 0 || onyxDigitsCmp(qm, m, n) >= 0) {
+    onyxDigitsSub(qm, qm, n + 1, m, n);
+  }
+
+  memcpy(result, qm, n * sizeof(OnyxDigit));
+}
+
+// result[0..n) = product[0..2n) / BASE^n mod modulus, product < modulus * BASE^n, product is overwritten
+static void onyxModulusReduceMontgomery(const OnyxModulus *self, OnyxDigit *result, OnyxDigit *product) {
+  const ptrdiff_t n = self->modulus.size;
+  const OnyxDigit *m = self->modulus.digits;
+  OnyxDigit top = 0;
+
+  for (ptrdiff_t i = 0; i < n; ++i) {
+    OnyxDigit carry = onyxDigitsAddMul(product + i, m, n, product[i] * self->inverse);
+
+    for (ptrdiff_t j = i + n; carry != 0 && j < 2 * n; ++j) {
+      product[j] += carry;
+      carry = (product[j] < carry);
+    }
+
+    top += carry;
+  }
+
+  if (top != 0 || onyxDigitsCmp(product + n, m, n) >= 0) {
+    onyxDigitsSub(result, product + n, n, m, n);
+  } else {
+    memcpy(result, product + n, n * sizeof(OnyxDigit));
+  }
+}
+
+// result[0..n) = lhs[0..n) * rhs[0..n) reduced, in Montgomery form if montgomery is set, result may alias lhs or rhs
+static void onyxModulusMul(const OnyxModulus *self, OnyxDigit *result, const OnyxDigit *lhs, const OnyxDigit *rhs, bool montgomery, OnyxDigit *scratch) {
+  const ptrdiff_t n = self->modulus.size;
+  OnyxDigit *product = scratch;
+  OnyxDigit *next = product + 2 * n;
+
+  onyxDigitsMul(product, lhs, n, rhs, n, next);
+
+  if (montgomery) {
+    onyxModulusReduceMontgomery(self, result, product);
+  } else {
+    onyxModulusReduceBarrett(self, result, product, next);
+  }
+}
+
+// residue[0..n) = value mod modulus, in [0, modulus)
+static void onyxModulusResidue(const OnyxModulus *self, OnyxDigit *residue, const OnyxInteger *value, AgateVM *vm) {
+  const ptrdiff_t n = self->modulus.size;
+  const OnyxInteger *reduced = value;
+
+  OnyxInteger quo;
+  onyxIntegerCreateEmpty(&quo);
+
+  OnyxInteger rem;
+  onyxIntegerCreateEmpty(&rem);
+
+  if (onyxIntegerCmpZero(value) < 0 || onyxNaturalCmp(value, &self->modulus) >= 0) {
+    onyxIntegerDiv(&quo, &rem, value, &self->modulus, vm);
+    reduced = &rem;
+  }
+
+  assert(reduced->size <= n);
+  memcpy(residue, reduced->digits, reduced->size * sizeof(OnyxDigit));
+  memset(residue + reduced->size, 0, (n - reduced->size) * sizeof(OnyxDigit));
+
+  onyxIntegerDestroy(&rem, vm);
+  onyxIntegerDestroy(&quo, vm);
+}
+
+static void onyxModulusMulInteger(const OnyxModulus *self, OnyxInteger *result, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
+  const ptrdiff_t n = self->modulus.size;
+  const ptrdiff_t buffer_size = 2 * n + onyxModulusScratch(self);
+  OnyxDigit *buffer = onyxScratchAllocate(vm, buffer_size);
+  OnyxDigit *l = buffer;
+  OnyxDigit *r = l + n;
+  OnyxDigit *scratch = r + n;
+
+  onyxModulusResidue(self, l, lhs, vm);
+  onyxModulusResidue(self, r, rhs, vm);
+  onyxModulusMul(self, l, l, r, false, scratch);
+
+  onyxNaturalEnsureCapacity(result, n, vm);
+  memcpy(result->digits, l, n * sizeof(OnyxDigit));
+  result->size = n;
+  result->positive = true;
+  onyxNaturalNormalize(result);
+
+  onyxScratchRelease(vm, buffer, buffer_size);
+}
+
+static ptrdiff_t onyxModulusPowWindow(ptrdiff_t bits) {
+  if (bits > 671) {
+    return 6;
+  }
+
+  if (bits > 239) {
+    return 5;
+  }
+
+  if (bits > 79) {
+    return 4;
+  }
+
+  if (bits > 23) {
+    return 3;
+  }
+
+  return bits > 1 ? 2 : 1;
+}
+
+// result = base^exponent mod modulus, exponent >= 0, with a sliding window on the bits of the exponent
+static void onyxModulusPowInteger(const OnyxModulus *self, OnyxInteger *result, const OnyxInteger *base, const OnyxInteger *exponent, AgateVM *vm) {
+  assert(onyxIntegerCmpZero(exponent) >= 0);
+  const uint64_t stats_start = onyxStatsEnter();
+  const ptrdiff_t n = self->modulus.size;
+  const bool montgomery = self->montgomery;
+
+  const ptrdiff_t bits = onyxNaturalBitLength(exponent);
+  const ptrdiff_t window = onyxModulusPowWindow(bits);
+  const ptrdiff_t count = (ptrdiff_t) 1 << (window - 1);
+
+  // table[i] = base^(2i + 1), then the accumulator and the scratch space
+  const ptrdiff_t buffer_size = (count + 2) * n + onyxModulusScratch(self);
+  OnyxDigit *buffer = onyxScratchAllocate(vm, buffer_size);
+  OnyxDigit *table = buffer;
+  OnyxDigit *square = table + count * n;
+  OnyxDigit *accumulator = square + n;
+  OnyxDigit *scratch = accumulator + n;
+
+  onyxModulusResidue(self, table, base, vm);
+
+  if (montgomery) {
+    onyxModulusMul(self, table, table, self->r2.digits, true, scratch);
+  }
+
+  if (count > 1) {
+    onyxModulusMul(self, square, table, table, montgomery, scratch);
+
+    for (ptrdiff_t i = 1; i < count; ++i) {
+      onyxModulusMul(self, table + i * n, table + (i - 1) * n, square, montgomery, scratch);
+    }
+  }
+
+  bool started = false;
+  ptrdiff_t i = bits - 1;
+
+  while (i >= 0) {
+    if (!onyxNaturalBit(exponent, i)) {
+      onyxModulusMul(self, accumulator, accumulator, accumulator, montgomery, scratch);
+      --i;
+      continue;
+    }
+
+    // the longest window [j, i] that ends with a set bit
+    ptrdiff_t j = i - window + 1;
+
+    if (j < 0) {
+      j = 0;
+    }
+
+    while (!onyxNaturalBit(exponent, j)) {
+      ++j;
+    }
+
+    ptrdiff_t value = 0;
+
+    for (ptrdiff_t k = i; k >= j; --k) {
+      value = (value << 1) | onyxNaturalBit(exponent, k);
+    }
+
+    const OnyxDigit *power = table + (value >> 1) * n;
+
+    if (started) {
+      for (ptrdiff_t k = i; k >= j; --k) {
+        onyxModulusMul(self, accumulator, accumulator, accumulator, montgomery, scratch);
+      }
+
+      onyxModulusMul(self, accumulator, accumulator, power, montgomery, scratch);
+    } else {
+      memcpy(accumulator, power, n * sizeof(OnyxDigit));
+      started = true;
+    }
+
+    i = j - 1;
+  }
+
+  if (!started) {
+    // exponent is zero
+    memset(accumulator, 0, n * sizeof(OnyxDigit));
+
+    if (onyxNaturalCmpShort(&self->modulus, 1) > 0) {
+      accumulator[0] = 1;
+    }
+  } else if (montgomery) {
+    OnyxDigit *product = scratch;
+    memcpy(product, accumulator, n * sizeof(OnyxDigit));
+    memset(product + n, 0, n * sizeof(OnyxDigit));
+    onyxModulusReduceMontgomery(self, accumulator, product);
+  }
+
+  onyxNaturalEnsureCapacity(result, n, vm);
+  memcpy(result->digits, accumulator, n * sizeof(OnyxDigit));
+  result->size = n;
+  result->positive = true;
+  onyxNaturalNormalize(result);
+
+  onyxScratchRelease(vm, buffer, buffer_size);
+  onyxStatsLeave(stats_start, ONYX_STATS_MODPOW, n);
+}
+
+/*
+ * Algorithms - Random numbers
+ *
+ * The digits are filled directly with SplitMix64 (Steele, Lea, Flood, 2014),
+ * seeded by the caller. It is fast and passes the usual statistical tests,
+ * but it is not a cryptographic generator.
+ */
+
+typedef struct {
+  uint64_t state;
+} OnyxRandom;
+
+static void onyxRandomCreate(OnyxRandom *self, uint64_t seed) {
+  self->state = seed;
+}
+
+static uint64_t onyxRandomNext(OnyxRandom *self) {
+  uint64_t z = (self->state += UINT64_C(0x9E3779B97F4A7C15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return z ^ (z >> 31);
+}
+
+// self = uniform random integer in [0, 2^bits)
+static void onyxIntegerRandomBits(OnyxInteger *self, ptrdiff_t bits, OnyxRandom *random, AgateVM *vm) {
+  assert(bits >= 0);
+  const ptrdiff_t size = bits / ONYX_DIGIT_BITS + 1;
+  onyxNaturalEnsureCapacity(self, size, vm);
+
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    self->digits[i] = (OnyxDigit) onyxRandomNext(random);
+  }
+
+  self->digits[size - 1] &= ((OnyxDigit) 1 << (bits % ONYX_DIGIT_BITS)) - 1;
+  self->size = size;
+  self->positive = true;
+  onyxNaturalNormalize(self);
+}
+
+// self = uniform random integer in [0, bound), bound > 0, by rejection
+static void onyxIntegerRandomBelow(OnyxInteger *self, const OnyxInteger *bound, OnyxRandom *random, AgateVM *vm) {
+  assert(onyxIntegerCmpZero(bound) > 0);
+  assert(self != bound);
+
+  // each attempt succeeds with a probability greater than 1/2
+  const ptrdiff_t bits = onyxNaturalBitLength(bound);
+
+  do {
+    onyxIntegerRandomBits(self, bits, random, vm);
+  } while (onyxNaturalCmp(self, bound) >= 0);
+}
+
+/*
+ * Algorithms - Primality
+ *
+ * Trial division by the primes below 1000, several primes at a time, rejects
+ * most composites and proves the primality of the values below 1000^2. The
+ * other values go through the Baillie-PSW test: a strong probable prime test
+ * to the base 2 followed by a strong Lucas probable prime test with the
+ * parameters of Selfridge's method A (Baillie, Wagstaff, 1980). No composite
+ * is known to pass it. Additional Miller-Rabin rounds use pseudo-random bases.
+ */
+
+#define ONYX_PRIME_TRIAL_BOUND 1000
+
+// odd primes below ONYX_PRIME_TRIAL_BOUND
+static const uint16_t onyxSmallPrimes[] = {
+  3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59,
+  61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131, 137,
+  139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223, 227,
+  229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311, 313,
+  317, 331, 337, 347, 349, 353, 359, 367, 373, 379, 383, 389, 397, 401, 409, 419,
+  421, 431, 433, 439, 443, 449, 457, 461, 463, 467, 479, 487, 491, 499, 503, 509,
+  521, 523, 541, 547, 557, 563, 569, 571, 577, 587, 593, 599, 601, 607, 613, 617,
+  619, 631, 641, 643, 647, 653, 659, 661, 673, 677, 683, 691, 701, 709, 719, 727,
+  733, 739, 743, 751, 757, 761, 769, 773, 787, 797, 809, 811, 821, 823, 827, 829,
+  839, 853, 857, 859, 863, 877, 881, 883, 887, 907, 911, 919, 929, 937, 941, 947,
+  953, 967, 971, 977, 983, 991, 997,
+};
+
+// seed of the bases of the additional rounds, so that the results are reproducible
+#define ONYX_PRIME_ROUNDS_SEED UINT64_C(0x5DEECE66D)
+
+// checks if value has an odd prime factor below the bound other than itself
+static bool onyxNaturalHasSmallFactor(const OnyxInteger *value) {
+  const ptrdiff_t count = sizeof(onyxSmallPrimes) / sizeof(onyxSmallPrimes[0]);
+  ptrdiff_t i = 0;
+
+  while (i < count) {
+    // one pass on the digits for as many primes as fit in a digit
+    OnyxDigit product = 1;
+    ptrdiff_t end = i;
+
+    while (end < count && product <= ONYX_DIGIT_MAX / onyxSmallPrimes[end]) {
+      product *= onyxSmallPrimes[end++];
+    }
+
+    const OnyxDigit residue = onyxNaturalModShort(value, product);
+
+    for (; i < end; ++i) {
+      if (residue % onyxSmallPrimes[i] == 0) {
+        return onyxNaturalCmpShort(value, onyxSmallPrimes[i]) != 0;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Jacobi symbol (a / n), n odd
+static int onyxJacobi(uint64_t a, uint64_t n) {
+  int result = 1;
+  a %= n;
+
+  while (a != 0) {
+    while (a % 2 == 0) {
+      a /= 2;
+
+      if (n % 8 == 3 || n % 8 == 5) {
+        result = -result;
+      }
+    }
+
+    uint64_t tmp = a;
+    a = n;
+    n = tmp;
+
+    if (a % 4 == 3 && n % 4 == 3) {
+      result = -result;
+    }
+
+    a %= n;
+  }
+
+  return n == 1 ? result : 0;
+}
+
+// Jacobi symbol (a / n) for an odd a whose magnitude fits in a digit, n odd
+static int onyxIntegerJacobiShort(int64_t a, const OnyxInteger *n) {
+  const OnyxDigit magnitude = a < 0 ? -(uint64_t) a : (uint64_t) a;
+  const unsigned n4 = n->digits[0] % 4;
+  assert(magnitude % 2 == 1);
+
+  int result = onyxJacobi(onyxNaturalModShort(n, magnitude), magnitude);
+
+  // (-1 / n), then the quadratic reciprocity
+  if (a < 0 && n4 == 3) {
+    result = -result;
+  }
+
+  if (magnitude % 4 == 3 && n4 == 3) {
+    result = -result;
+  }
+
+  return result;
+}
+
+// result = value mod modulus, in [0, modulus), result and value must be different
+static void onyxModulusReduceInteger(const OnyxModulus *self, OnyxInteger *result, const OnyxInteger *value, AgateVM *vm) {
+  OnyxInteger quo;
+  onyxIntegerCreateEmpty(&quo);
+  onyxIntegerDiv(&quo, result, value, &self->modulus, vm);
+  onyxIntegerDestroy(&quo, vm);
+}
+
+// value = value - other mod modulus, both in [0, modulus)
+static void onyxModulusSubInteger(const OnyxModulus *self, OnyxInteger *value, const OnyxInteger *other, AgateVM *vm) {
+  onyxIntegerSub(value, value, other, vm);
+
+  if (onyxIntegerCmpZero(value) < 0) {
+    onyxIntegerAdd(value, value, &self->modulus, vm);
+  }
+}
+
+// value = value / 2 mod modulus, value in [0, modulus), the modulus is odd
+static void onyxModulusHalveInteger(const OnyxModulus *self, OnyxInteger *value, AgateVM *vm) {
+  if (value->digits[0] & 1) {
+    onyxNaturalAdd(value, value, &self->modulus, vm);
+  }
+
+  onyxIntegerShiftRight(value, value, 1, vm);
+}
+
+// returns s such that value = odd * 2^s, value > 0
+static ptrdiff_t onyxNaturalTrailingZeros(const OnyxInteger *value) {
+  ptrdiff_t s = 0;
+
+  while (!onyxNaturalBit(value, s)) {
+    ++s;
+  }
+
+  return s;
+}
+
+// strong probable prime test to the base, the modulus is odd and greater than 3
+static bool onyxModulusIsStrongProbablePrime(const OnyxModulus *self, const OnyxInteger *base, AgateVM *vm) {
+  // n - 1 = d * 2^s, d odd
+  OnyxInteger minus_one;
+  onyxIntegerCreateEmpty(&minus_one);
+  onyxIntegerCopy(&minus_one, &self->modulus, vm);
+  onyxNaturalSubShort(&minus_one, &minus_one, 1, vm);
+
+  const ptrdiff_t s = onyxNaturalTrailingZeros(&minus_one);
+
+  OnyxInteger d;
+  onyxIntegerCreateEmpty(&d);
+  onyxIntegerShiftRight(&d, &minus_one, s, vm);
+
+  OnyxInteger x;
+  onyxIntegerCreateEmpty(&x);
+  onyxModulusPowInteger(self, &x, base, &d, vm);
+
+  bool result = onyxNaturalCmpShort(&x, 1) == 0 || onyxNaturalCmp(&x, &minus_one) == 0;
+
+  for (ptrdiff_t r = 1; !result && r < s; ++r) {
+    onyxModulusMulInteger(self, &x, &x, &x, vm);
+
+    if (onyxNaturalCmp(&x, &minus_one) == 0) {
+      result = true;
+    } else if (onyxNaturalCmpShort(&x, 1) == 0) {
+      break;
+    }
+  }
+
+  onyxIntegerDestroy(&x, vm);
+  onyxIntegerDestroy(&d, vm);
+  onyxIntegerDestroy(&minus_one, vm);
+  return result;
+}
+
+// strong Lucas probable prime test with P = 1 and Q = (1 - D) / 4, the modulus is odd, not a square and has no small factor
+static bool onyxModulusIsStrongLucasProbablePrime(const OnyxModulus *self, AgateVM *vm) {
+  const OnyxInteger *n = &self->modulus;
+
+  // first D in 5, -7, 9, -11, ... such that (D / n) = -1, it exists as n is not a square
+  int64_t discriminant = 5;
+  int jacobi;
+
+  while ((jacobi = onyxIntegerJacobiShort(discriminant, n)) == 1) {
+    discriminant = discriminant > 0 ? -(discriminant + 2) : -discriminant + 2;
+  }
+
+  if (jacobi == 0) {
+    // |D| is a factor of n, which is greater than |D| as it has no small factor
+    return false;
+  }
+
+  const OnyxDigit discriminant_magnitude = discriminant < 0 ? -discriminant : discriminant;
+
+  OnyxInteger tmp;
+  onyxIntegerCreateEmpty(&tmp);
+
+  OnyxInteger q;
+  onyxIntegerCreateEmpty(&q);
+  onyxIntegerFromInt(&tmp, (1 - discriminant) / 4, vm);
+  onyxModulusReduceInteger(self, &q, &tmp, vm);
+
+  // n + 1 = d * 2^s, d odd
+  OnyxInteger d;
+  onyxIntegerCreateEmpty(&d);
+  onyxNaturalAddShort(&tmp, n, 1, vm);
+  tmp.positive = true;
+  const ptrdiff_t s = onyxNaturalTrailingZeros(&tmp);
+  onyxIntegerShiftRight(&d, &tmp, s, vm);
+
+  // U(k), V(k) and Q^k for k = 1, then for the leading bits of d
+  OnyxInteger u;
+  onyxIntegerCreateEmpty(&u);
+  onyxIntegerFromInt(&u, 1, vm);
+
+  OnyxInteger v;
+  onyxIntegerCreateEmpty(&v);
+  onyxIntegerFromInt(&v, 1, vm);
+
+  OnyxInteger qk;
+  onyxIntegerCreateEmpty(&qk);
+  onyxIntegerCopy(&qk, &q, vm);
+
+  for (ptrdiff_t i = onyxNaturalBitLength(&d) - 2; i >= 0; --i) {
+    // U(2k) = U(k) V(k), V(2k) = V(k)^2 - 2 Q^k
+    onyxModulusMulInteger(self, &u, &u, &v, vm);
+    onyxModulusMulInteger(self, &v, &v, &v, vm);
+    onyxModulusSubInteger(self, &v, &qk, vm);
+    onyxModulusSubInteger(self, &v, &qk, vm);
+    onyxModulusMulInteger(self, &qk, &qk, &qk, vm);
+
+    if (onyxNaturalBit(&d, i)) {
+      // U(k + 1) = (U(k) + V(k)) / 2, V(k + 1) = (D U(k) + V(k)) / 2
+      onyxIntegerMulShort(&tmp, &u, discriminant_magnitude, discriminant > 0, vm);
+      onyxIntegerAdd(&tmp, &tmp, &v, vm);
+
+      onyxNaturalAdd(&u, &u, &v, vm);
+
+      if (onyxNaturalCmp(&u, n) >= 0) {
+        onyxNaturalSub(&u, &u, n, vm);
+      }
+
+      onyxModulusHalveInteger(self, &u, vm);
+
+      onyxModulusReduceInteger(self, &v, &tmp, vm);
+      onyxModulusHalveInteger(self, &v, vm);
+
+      onyxModulusMulInteger(self, &qk, &qk, &q, vm);
+    }
+  }
+
+  bool result = onyxNaturalCmpZero(&u) == 0 || onyxNaturalCmpZero(&v) == 0;
+
+  for (ptrdiff_t r = 1; !result && r < s; ++r) {
+    onyxModulusMulInteger(self, &v, &v, &v, vm);
+    onyxModulusSubInteger(self, &v, &qk, vm);
+    onyxModulusSubInteger(self, &v, &qk, vm);
+    onyxModulusMulInteger(self, &qk, &qk, &qk, vm);
+    result = onyxNaturalCmpZero(&v) == 0;
+  }
+
+  onyxIntegerDestroy(&qk, vm);
+  onyxIntegerDestroy(&v, vm);
+  onyxIntegerDestroy(&u, vm);
+  onyxIntegerDestroy(&d, vm);
+  onyxIntegerDestroy(&q, vm);
+  onyxIntegerDestroy(&tmp, vm);
+  return result;
+}
+
+// Baillie-PSW test followed by rounds of Miller-Rabin
+static bool onyxIntegerIsProbablePrime(const OnyxInteger *value, ptrdiff_t rounds, AgateVM *vm) {
+  if (onyxIntegerCmpShort(value, 2, true) <= 0) {
+    return onyxIntegerCmpShort(value, 2, true) == 0;
+  }
+
+  if ((value->digits[0] & 1) == 0 || onyxNaturalHasSmallFactor(value)) {
+    return false;
+  }
+
+  if (value->size == 1 && value->digits[0] < ONYX_PRIME_TRIAL_BOUND * ONYX_PRIME_TRIAL_BOUND) {
+    return true;
+  }
+
+  if (onyxIntegerIsSquare(value, vm)) {
+    return false;
+  }
+
+  OnyxModulus modulus;
+  onyxModulusCreate(&modulus, value, vm);
+
+  OnyxInteger base;
+  onyxIntegerCreateEmpty(&base);
+  onyxIntegerFromInt(&base, 2, vm);
+
+  bool result = onyxModulusIsStrongProbablePrime(&modulus, &base, vm) && onyxModulusIsStrongLucasProbablePrime(&modulus, vm);
+
+  if (result && rounds > 0) {
+    // bases in [2, n - 2]
+    OnyxInteger bound;
+    onyxIntegerCreateEmpty(&bound);
+    onyxIntegerCopy(&bound, value, vm);
+    onyxNaturalSubShort(&bound, &bound, 3, vm);
+
+    OnyxRandom random;
+    onyxRandomCreate(&random, ONYX_PRIME_ROUNDS_SEED);
+
+    for (ptrdiff_t i = 0; result && i < rounds; ++i) {
+      onyxIntegerRandomBelow(&base, &bound, &random, vm);
+      onyxNaturalAddShort(&base, &base, 2, vm);
+      result = onyxModulusIsStrongProbablePrime(&modulus, &base, vm);
+    }
+
+    onyxIntegerDestroy(&bound, vm);
+  }
+
+  onyxIntegerDestroy(&base, vm);
+  onyxModulusDestroy(&modulus, vm);
+  return result;
+}
+
+// self = smallest probable prime greater than value
+static void onyxIntegerNextPrime(OnyxInteger *self, const OnyxInteger *value, AgateVM *vm) {
+  if (onyxIntegerCmpShort(value, 2, true) < 0) {
+    onyxIntegerFromInt(self, 2, vm);
+    return;
+  }
+
+  onyxIntegerCopy(self, value, vm);
+  onyxNaturalAddShort(self, self, (self->digits[0] & 1) ? 2 : 1, vm);
+
+  while (!onyxIntegerIsProbablePrime(self, 0, vm)) {
+    onyxNaturalAddShort(self, self, 2, vm);
+  }
+}
+
+/*
+ * API implementation
+ */
+
+/*
+ * The VM state keeps handles on the Integer and Rational classes while an
+ * Integer or a Rational is alive in the VM, so that the results are created
+ * without a lookup. It also owns the scratch arena of the VM. The handles and
+ * the arena are released with the last of them.
+ */
+
+typedef struct AgateMathBigState {
+  AgateVM *vm;
+  AgateHandle *integer_class;
+  AgateHandle *rational_class;
+  OnyxScratch scratch;
+  ptrdiff_t count;
+  struct AgateMathBigState *next;
+} AgateMathBigState;
+
+static AgateMathBigState *agateMathBigStates = NULL;
+static atomic_flag agateMathBigStatesLock = ATOMIC_FLAG_INIT;
+
+static AgateMathBigState *agateMathBigStateFind(AgateVM *vm) {
+  while (atomic_flag_test_and_set_explicit(&agateMathBigStatesLock, memory_order_acquire)) {
+    // spin
+  }
+
+  AgateMathBigState *state = agateMathBigStates;
+
+  while (state != NULL && state->vm != vm) {
+    state = state->next;
+  }
+
+  atomic_flag_clear_explicit(&agateMathBigStatesLock, memory_order_release);
+  return state;
+}
+
+static OnyxScratch *onyxScratchFind(AgateVM *vm) {
+  AgateMathBigState *state = agateMathBigStateFind(vm);
+  return state != NULL ? &state->scratch : NULL;
+}
+
+static AgateMathBigState *agateMathBigStateAcquire(AgateVM *vm) {
+  AgateMathBigState *state = agateMathBigStateFind(vm);
+
+  if (state == NULL) {
+    // no Integer is alive in the VM, a collection can not release the state meanwhile
+    state = agateMemoryAllocate(vm, NULL, sizeof(AgateMathBigState));
+    state->vm = vm;
+    state->count = 0;
+    onyxScratchCreate(&state->scratch);
+
+    ptrdiff_t class_slot = agateSlotAllocate(vm);
+    agateGetVariable(vm, "math/big", "Integer", class_slot);
+    state->integer_class = agateSlotGetHandle(vm, class_slot);
+    agateGetVariable(vm, "math/big", "Rational", class_slot);
+    state->rational_class = agateSlotGetHandle(vm, class_slot);
+
+    while (atomic_flag_test_and_set_explicit(&agateMathBigStatesLock, memory_order_acquire)) {
+      // spin
+    }
+
+    state->next = agateMathBigStates;
+    agateMathBigStates = state;
+
+    atomic_flag_clear_explicit(&agateMathBigStatesLock, memory_order_release);
+  }
+
+  ++state->count;
+  return state;
+}
+
+static void agateMathBigStateRelease(AgateVM *vm) {
+  AgateMathBigState *state = agateMathBigStateFind(vm);
+
+  if (state == NULL) {
+    return;
+  }
+
+  assert(state->count > 0);
+
+  if (--state->count > 0) {
+    return;
+  }
+
+  while (atomic_flag_test_and_set_explicit(&agateMathBigStatesLock, memory_order_acquire)) {
+    // spin
+  }
+
+  AgateMathBigState **link = &agateMathBigStates;
+
+  while (*link != state) {
+    link = &(*link)->next;
+  }
+
+  *link = state->next;
+
+  atomic_flag_clear_explicit(&agateMathBigStatesLock, memory_order_release);
+
+  agateReleaseHandle(vm, state->integer_class);
+  agateReleaseHandle(vm, state->rational_class);
+  onyxScratchDestroy(&state->scratch, vm);
+  agateMemoryAllocate(vm, state, 0);
+}
+
+// aborts the current method with the message, the method must return without setting a result
+static void agateMathBigAbort(AgateVM *vm, const char *message) {
+  ptrdiff_t message_slot = agateSlotAllocate(vm);
+  agateSlotSetString(vm, message_slot, message);
+  agateAbort(vm, message_slot);
+}
+
+// creates a new Integer in the slot
+static OnyxInteger *agateIntegerSlotNew(AgateVM *vm, ptrdiff_t slot) {
+  AgateMathBigState *state = agateMathBigStateAcquire(vm);
+
+  ptrdiff_t class_slot = agateSlotAllocate(vm);
+  agateSlotSetHandle(vm, class_slot, state->integer_class);
+
+  OnyxInteger *integer = agateSlotSetForeign(vm, slot, class_slot);
+  onyxIntegerCreateEmpty(integer);
+  return integer;
+}
+
+// checks if the slot is an Int whose magnitude fits in a digit
+static bool agateIntegerSlotShort(AgateVM *vm, ptrdiff_t slot, OnyxDigit *magnitude, bool *positive) {
+  if (agateSlotType(vm, slot) != AGATE_TYPE_INT) {
+    return false;
+  }
+
+  int64_t value = agateSlotGetInt(vm, slot);
+  // computed on unsigned integers because -INT64_MIN is UB
+  uint64_t value_magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+  if (value_magnitude > ONYX_DIGIT_MAX) {
+    return false;
+  }
+
+  *magnitude = value_magnitude;
+  *positive = value >= 0;
+  return true;
+}
+
+static OnyxInteger *agateIntegerValidate(AgateVM *vm, OnyxInteger *integer, ptrdiff_t slot) {
+  if (agateSlotType(vm, slot) == AGATE_TYPE_INT) {
+    int64_t val = agateSlotGetInt(vm, slot);
+    onyxIntegerFromInt(integer, val, vm);
+    return integer;
+  }
+
+  if (agateSlotType(vm, slot) == AGATE_TYPE_STRING) {
+    const char *str = agateSlotGetString(vm, slot);
+
+    if (!onyxIntegerFromString(integer, str, 10, vm)) {
+      // TODO: error
+      return NULL;
+    }
+
+    return integer;
+  }
+
+  if (agateSlotType(vm, slot) == AGATE_TYPE_FOREIGN && agateSlotGetForeignTag(vm, slot) == AGATE_MATH_BIG_INTEGER_TAG) {
+    return agateSlotGetForeign(vm, slot);
+  }
+
+  // TODO: error
+  return NULL;
+}
+
+// class
+
+static ptrdiff_t agateIntegerAllocate(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return sizeof(OnyxInteger);
+}
+
+static uint64_t agateIntegerTag(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return AGATE_MATH_BIG_INTEGER_TAG;
+}
+
+void agateIntegerDestroy(AgateVM *vm, const char *unit_name, const char *class_name, void *data) {
+  OnyxInteger *integer = data;
+  onyxIntegerDestroy(integer, vm);
+  agateMathBigStateRelease(vm);
+}
+
+// methods
+
+static void agateIntegerNew0(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  onyxIntegerCreateEmpty(integer);
+  agateMathBigStateAcquire(vm);
+  onyxIntegerFromInt(integer, 0, vm);
+}
+
+static void agateIntegerNew1(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  onyxIntegerCreateEmpty(integer);
+  agateMathBigStateAcquire(vm);
+
+  OnyxInteger *result = agateIntegerValidate(vm, integer, 1);
+
+  if (result != NULL && result != integer) {
+    onyxIntegerCopy(integer, result, vm);
+  }
+}
+
+static void agateIntegerNew2(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  onyxIntegerCreateEmpty(integer);
+  agateMathBigStateAcquire(vm);
+
+  const char *str = agateSlotGetString(vm, 1);
+  int64_t base = agateSlotGetInt(vm, 2);
+
+  if (base < 2 || base > 36) {
+    // TODO: error
+  }
+
+  if (!onyxIntegerFromString(integer, str, base, vm)) {
+      // TODO: error
+  }
+}
+
+static void agateIntegerPositive(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, integer->positive);
+}
+
+static void agateIntegerIsZero(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, integer->size == 1 && integer->digits[0] == 0);
+}
+
+static void agateIntegerIsPerfectSquare(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, onyxIntegerIsSquare(integer, vm));
+}
+
+static void agateIntegerCmp(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive)) {
+    agateSlotSetInt(vm, AGATE_RETURN_SLOT, onyxIntegerCmpShort(lhs, rhs_short, rhs_positive));
+    return;
+  }
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+  int cmp = onyxIntegerCmp(lhs, rhs);
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, cmp);
+
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerPlus(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerCopy(result, integer, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerMinus(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerCopy(result, integer, vm);
+  result->positive = !result->positive;
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerAdd(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive)) {
+    onyxIntegerAddShort(result, lhs, rhs_short, rhs_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerAdd(result, lhs, rhs, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerSub(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive)) {
+    onyxIntegerAddShort(result, lhs, rhs_short, !rhs_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerSub(result, lhs, rhs, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerMul(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive)) {
+    onyxIntegerMulShort(result, lhs, rhs_short, rhs_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerMul(result, lhs, rhs, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerDiv(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive) && rhs_short != 0) {
+    OnyxDigit discarded;
+    onyxIntegerDivShort(result, &discarded, lhs, rhs_short, rhs_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+    OnyxInteger discarded;
+    onyxIntegerCreateEmpty(&discarded);
+    onyxIntegerDiv(result, &discarded, lhs, rhs, vm);
+    onyxIntegerDestroy(&discarded, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerMod(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  OnyxDigit rhs_short;
+  bool rhs_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &rhs_short, &rhs_positive) && rhs_short != 0) {
+    onyxNaturalEnsureCapacity(result, 1, vm);
+    result->digits[0] = onyxIntegerModShort(lhs, rhs_short);
+    result->size = 1;
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+    OnyxInteger discarded;
+    onyxIntegerCreateEmpty(&discarded);
+    onyxIntegerDiv(&discarded, result, lhs, rhs, vm);
+    onyxIntegerDestroy(&discarded, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerShift(AgateVM *vm, bool left) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
+  }
+
+  int64_t shift = agateSlotGetInt(vm, 1);
+  // computed on unsigned integers because -INT64_MIN is UB
+  uint64_t amount = shift < 0 ? UINT64_C(0) - (uint64_t) shift : (uint64_t) shift;
+
+  if (shift < 0) {
+    left = !left;
+  }
+
+  // the size in bits of the result must fit in a ptrdiff_t
+  if (left && amount > (uint64_t) (PTRDIFF_MAX - onyxNaturalBitLength(integer))) {
+    agateMathBigAbort(vm, "Shift amount is too large.");
+    return;
+  }
+
+  if (amount > (uint64_t) PTRDIFF_MAX) {
+    amount = PTRDIFF_MAX;
+  }
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  if (left) {
+    onyxIntegerShiftLeft(result, integer, (ptrdiff_t) amount, vm);
+  } else {
+    onyxIntegerShiftRight(result, integer, (ptrdiff_t) amount, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerLeftShift(AgateVM *vm) {
+  agateIntegerShift(vm, true);
+}
+
+static void agateIntegerRightShift(AgateVM *vm) {
+  agateIntegerShift(vm, false);
+}
+
+static void agateIntegerBitwise(AgateVM *vm, OnyxBitwise op) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerBitwise(result, lhs, rhs, op, vm);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerAnd(AgateVM *vm) {
+  agateIntegerBitwise(vm, ONYX_BITWISE_AND);
+}
+
+static void agateIntegerOr(AgateVM *vm) {
+  agateIntegerBitwise(vm, ONYX_BITWISE_OR);
+}
+
+static void agateIntegerXor(AgateVM *vm) {
+  agateIntegerBitwise(vm, ONYX_BITWISE_XOR);
+}
+
+static void agateIntegerNot(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerNot(result, integer, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerBitLength(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, onyxNaturalBitLength(integer));
+}
+
+static void agateIntegerPopCount(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, onyxNaturalPopCount(integer));
+}
+
+static void agateIntegerTestBit(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
+  }
+
+  int64_t index = agateSlotGetInt(vm, 1);
+
+  if (index < 0) {
+    agateMathBigAbort(vm, "Bit index must be non-negative.");
+    return;
+  }
+
+  if (index > PTRDIFF_MAX) {
+    index = PTRDIFF_MAX;
+  }
+
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, onyxIntegerTestBit(integer, (ptrdiff_t) index));
+}
+
+static void agateIntegerSet(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *self = agateSlotGetForeign(vm, 0);
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *other = agateIntegerValidate(vm, &local, 1);
+
+  onyxIntegerCopy(self, other, vm);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, 0);
+
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerAddAssign(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *self = agateSlotGetForeign(vm, 0);
+
+  OnyxDigit other_short;
+  bool other_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &other_short, &other_positive)) {
+    onyxIntegerAddShort(self, self, other_short, other_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *other = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerAdd(self, self, other, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, 0);
+}
+
+static void agateIntegerSubAssign(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *self = agateSlotGetForeign(vm, 0);
+
+  OnyxDigit other_short;
+  bool other_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &other_short, &other_positive)) {
+    onyxIntegerAddShort(self, self, other_short, !other_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *other = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerSub(self, self, other, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, 0);
+}
+
+static void agateIntegerMulAssign(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *self = agateSlotGetForeign(vm, 0);
+
+  OnyxDigit other_short;
+  bool other_positive;
+
+  if (agateIntegerSlotShort(vm, 1, &other_short, &other_positive)) {
+    onyxIntegerMulShort(self, self, other_short, other_positive, vm);
+  } else {
+    OnyxInteger local;
+    onyxIntegerCreateEmpty(&local);
+    OnyxInteger *other = agateIntegerValidate(vm, &local, 1);
+
+    onyxIntegerMul(self, self, other, vm);
+
+    onyxIntegerDestroy(&local, vm);
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, 0);
+}
+
+static void agateIntegerAddMul(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *self = agateSlotGetForeign(vm, 0);
+
+  OnyxInteger local_lhs;
+  onyxIntegerCreateEmpty(&local_lhs);
+  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
+
+  OnyxInteger local_rhs;
+  onyxIntegerCreateEmpty(&local_rhs);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+
+  onyxIntegerAddMul(self, lhs, rhs, vm);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, 0);
+
+  onyxIntegerDestroy(&local_lhs, vm);
+  onyxIntegerDestroy(&local_rhs, vm);
+}
+
+static void agateIntegerExp(AgateVM *vm) {
+  OnyxInteger local_base;
+  onyxIntegerCreateEmpty(&local_base);
+  OnyxInteger *base = agateIntegerValidate(vm, &local_base, 1);
+
+  OnyxInteger local_exponent;
+  onyxIntegerCreateEmpty(&local_exponent);
+  OnyxInteger *exponent = agateIntegerValidate(vm, &local_exponent, 2);
+
+  if (base == NULL || exponent == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(exponent) < 0) {
+    agateMathBigAbort(vm, "Exponent must be non-negative.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+    if (onyxIntegerPow(result, base, exponent, vm)) {
+      agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+    } else {
+      agateMathBigAbort(vm, "Result is too large.");
+    }
+  }
+
+  onyxIntegerDestroy(&local_base, vm);
+  onyxIntegerDestroy(&local_exponent, vm);
+}
+
+static void agateIntegerModPow(AgateVM *vm) {
+  OnyxInteger local_base;
+  onyxIntegerCreateEmpty(&local_base);
+  OnyxInteger *base = agateIntegerValidate(vm, &local_base, 1);
+
+  OnyxInteger local_exponent;
+  onyxIntegerCreateEmpty(&local_exponent);
+  OnyxInteger *exponent = agateIntegerValidate(vm, &local_exponent, 2);
+
+  OnyxInteger local_modulus;
+  onyxIntegerCreateEmpty(&local_modulus);
+  OnyxInteger *modulus = agateIntegerValidate(vm, &local_modulus, 3);
+
+  if (base == NULL || exponent == NULL || modulus == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(exponent) < 0) {
+    agateMathBigAbort(vm, "Exponent must be non-negative.");
+  } else if (onyxIntegerCmpZero(modulus) <= 0) {
+    agateMathBigAbort(vm, "Modulus must be positive.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+    OnyxModulus context;
+    onyxModulusCreate(&context, modulus, vm);
+    onyxModulusPowInteger(&context, result, base, exponent, vm);
+    onyxModulusDestroy(&context, vm);
+
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
+
+  onyxIntegerDestroy(&local_base, vm);
+  onyxIntegerDestroy(&local_exponent, vm);
+  onyxIntegerDestroy(&local_modulus, vm);
+}
+
+static void agateIntegerGcd(AgateVM *vm) {
+  OnyxInteger local_lhs;
+  onyxIntegerCreateEmpty(&local_lhs);
+  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
+
+  OnyxInteger local_rhs;
+  onyxIntegerCreateEmpty(&local_rhs);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerGcdExt(result, NULL, NULL, lhs, rhs, vm);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+
+  onyxIntegerDestroy(&local_lhs, vm);
+  onyxIntegerDestroy(&local_rhs, vm);
+}
+
+static void agateIntegerXgcd(AgateVM *vm) {
+  OnyxInteger local_lhs;
+  onyxIntegerCreateEmpty(&local_lhs);
+  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
+
+  OnyxInteger local_rhs;
+  onyxIntegerCreateEmpty(&local_rhs);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+
+  ptrdiff_t gcd_slot = agateSlotAllocate(vm);
+  OnyxInteger *gcd = agateIntegerSlotNew(vm, gcd_slot);
+
+  ptrdiff_t s_slot = agateSlotAllocate(vm);
+  OnyxInteger *s = agateIntegerSlotNew(vm, s_slot);
+
+  ptrdiff_t t_slot = agateSlotAllocate(vm);
+  OnyxInteger *t = agateIntegerSlotNew(vm, t_slot);
+
+  onyxIntegerGcdExt(gcd, s, t, lhs, rhs, vm);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  agateSlotArrayNew(vm, result_slot);
+  agateSlotArrayInsert(vm, result_slot, 0, gcd_slot);
+  agateSlotArrayInsert(vm, result_slot, 1, s_slot);
+  agateSlotArrayInsert(vm, result_slot, 2, t_slot);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+
+  onyxIntegerDestroy(&local_lhs, vm);
+  onyxIntegerDestroy(&local_rhs, vm);
+}
+
+static void agateIntegerModInv(AgateVM *vm) {
+  OnyxInteger local_value;
+  onyxIntegerCreateEmpty(&local_value);
+  OnyxInteger *value = agateIntegerValidate(vm, &local_value, 1);
+
+  OnyxInteger local_modulus;
+  onyxIntegerCreateEmpty(&local_modulus);
+  OnyxInteger *modulus = agateIntegerValidate(vm, &local_modulus, 2);
+
+  if (value == NULL || modulus == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(modulus) <= 0) {
+    agateMathBigAbort(vm, "Modulus must be positive.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+    if (onyxIntegerModInv(result, value, modulus, vm)) {
+      agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+    } else {
+      // the value and the modulus are not coprime
+      agateSlotSetNil(vm, AGATE_RETURN_SLOT);
+    }
+  }
+
+  onyxIntegerDestroy(&local_value, vm);
+  onyxIntegerDestroy(&local_modulus, vm);
+}
+
+static void agateIntegerISqrt(AgateVM *vm) {
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *value = agateIntegerValidate(vm, &local, 1);
+
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(value) < 0) {
+    agateMathBigAbort(vm, "Square root of a negative number.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+    bool defined = onyxIntegerRoot(result, value, 2, vm);
+    assert(defined);
+    (void) defined;
+
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
+
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerIRoot(AgateVM *vm) {
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *value = agateIntegerValidate(vm, &local, 1);
+
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (agateSlotType(vm, 2) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+  } else if (agateSlotGetInt(vm, 2) <= 0) {
+    agateMathBigAbort(vm, "Root degree must be positive.");
+  } else if (onyxIntegerCmpZero(value) < 0 && agateSlotGetInt(vm, 2) % 2 == 0) {
+    agateMathBigAbort(vm, "Even root of a negative number.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+    bool defined = onyxIntegerRoot(result, value, agateSlotGetInt(vm, 2), vm);
+    assert(defined);
+    (void) defined;
+
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
+
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerSum(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_ARRAY) {
+    agateMathBigAbort(vm, "Array expected.");
+    return;
+  }
+
+  ptrdiff_t count = agateSlotArraySize(vm, 1);
+  ptrdiff_t element_slot = agateSlotAllocate(vm);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerFromInt(result, 0, vm);
+
+  // the negative terms are accumulated separately and subtracted at the end
+  OnyxInteger negative;
+  onyxIntegerCreateEmpty(&negative);
+  onyxIntegerFromInt(&negative, 0, vm);
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+
+  bool valid = true;
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    agateSlotArrayGet(vm, 1, i, element_slot);
+
+    OnyxDigit magnitude;
+    bool positive;
+
+    if (agateIntegerSlotShort(vm, element_slot, &magnitude, &positive)) {
+      if (magnitude != 0) {
+        onyxNaturalAccumulate(positive ? result : &negative, &magnitude, 1, vm);
+      }
+
+      continue;
+    }
+
+    OnyxInteger *value = agateIntegerValidate(vm, &local, element_slot);
+
+    if (value == NULL) {
+      valid = false;
+      break;
+    }
+
+    onyxNaturalAccumulate(value->positive ? result : &negative, value->digits, value->size, vm);
+  }
+
+  if (valid) {
+    onyxIntegerSub(result, result, &negative, vm);
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  } else {
+    agateMathBigAbort(vm, "Array of integers expected.");
+  }
+
+  onyxIntegerDestroy(&local, vm);
+  onyxIntegerDestroy(&negative, vm);
+}
+
+static void agateIntegerProduct(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_ARRAY) {
+    agateMathBigAbort(vm, "Array expected.");
+    return;
+  }
+
+  ptrdiff_t count = agateSlotArraySize(vm, 1);
+  ptrdiff_t element_slot = agateSlotAllocate(vm);
+
+  // the factors are allocated once as an integer may point to its own small digits
+  OnyxInteger *factors = agateMemoryAllocate(vm, NULL, (count + 1) * sizeof(OnyxInteger));
+  ptrdiff_t factor_count = 0;
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+
+  // consecutive short factors are packed in a single digit
+  OnyxDigit packed = 1;
+  bool positive = true;
+  bool valid = true;
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    agateSlotArrayGet(vm, 1, i, element_slot);
+
+    OnyxDigit magnitude;
+    bool element_positive;
+
+    if (agateIntegerSlotShort(vm, element_slot, &magnitude, &element_positive)) {
+      positive = (positive == element_positive);
+      OnyxDoubleDigit product = (OnyxDoubleDigit) packed * magnitude;
+
+      if (product <= ONYX_DIGIT_MAX) {
+        packed = (OnyxDigit) product;
+        continue;
+      }
+
+      OnyxInteger *factor = &factors[factor_count++];
+      onyxIntegerCreateEmpty(factor);
+      factor->digits[0] = packed;
+      factor->size = 1;
+      packed = magnitude;
+      continue;
+    }
+
+    OnyxInteger *value = agateIntegerValidate(vm, &local, element_slot);
+
+    if (value == NULL) {
+      valid = false;
+      break;
     }
-    return 1;
+
+    positive = (positive == value->positive);
+
+    OnyxInteger *factor = &factors[factor_count++];
+    onyxIntegerCreateEmpty(factor);
+    onyxNaturalCopy(factor, value, vm);
   }
 
-  if (!rhs->positive) {
-    return -cmp;
+  OnyxInteger *factor = &factors[factor_count++];
+  onyxIntegerCreateEmpty(factor);
+  factor->digits[0] = packed;
+  factor->size = 1;
+
+  if (valid) {
+    onyxIntegerProductTree(factors, factor_count, vm);
+
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+    onyxIntegerMove(result, &factors[0], vm);
+    result->positive = positive || onyxNaturalCmpZero(result) == 0;
+
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  } else {
+    agateMathBigAbort(vm, "Array of integers expected.");
   }
-  if (onyxNaturalCmpZero(lhs) && onyxNaturalCmpZero(rhs)) {
-    return 0;
+
+  for (ptrdiff_t i = 0; i < factor_count; ++i) {
+    onyxIntegerDestroy(&factors[i], vm);
   }
-  return -1;
+
+  agateMemoryAllocate(vm, factors, 0);
+  onyxIntegerDestroy(&local, vm);
 }
 
-static int onyxIntegerCmpZero(const OnyxInteger *self) {
-  int cmp = onyxNaturalCmpZero(self);
-  return self->positive ? cmp : -cmp;
+// checks if the slot is an Int in [0, UINT32_MAX]
+static bool agateIntegerSlotCount(AgateVM *vm, ptrdiff_t slot, uint32_t *count) {
+  if (agateSlotType(vm, slot) != AGATE_TYPE_INT) {
+    return false;
+  }
+
+  int64_t value = agateSlotGetInt(vm, slot);
+
+  if (value < 0 || value > UINT32_MAX) {
+    return false;
+  }
+
+  *count = (uint32_t) value;
+  return true;
 }
 
-static void onyxIntegerAdd(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  if (lhs->positive == rhs->positive) {
-    self->positive = lhs->positive;
-    onyxNaturalAdd(self, lhs, rhs, vm);
+static void agateIntegerFactorial(AgateVM *vm) {
+  uint32_t n;
+
+  if (!agateIntegerSlotCount(vm, 1, &n)) {
+    agateMathBigAbort(vm, "Non-negative Int below 2^32 expected.");
     return;
   }
 
-  assert(lhs->positive == !rhs->positive);
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerFactorial(result, n, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+static void agateIntegerBinomial(AgateVM *vm) {
+  uint32_t n;
 
-  if (onyxNaturalCmp(lhs, rhs) > 0) {
-    self->positive = lhs->positive;
-    onyxNaturalSub(self, lhs, rhs, vm);
+  if (!agateIntegerSlotCount(vm, 1, &n)) {
+    agateMathBigAbort(vm, "Non-negative Int below 2^32 expected.");
+    return;
+  }
+
+  if (agateSlotType(vm, 2) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
+  }
+
+  int64_t k = agateSlotGetInt(vm, 2);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+
+  if (k < 0 || k > n) {
+    onyxIntegerFromInt(result, 0, vm);
   } else {
-    self->positive = !lhs->positive;
-    onyxNaturalSub(self, rhs, lhs, vm);
+    onyxIntegerBinomial(result, n, (uint32_t) k, vm);
   }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
 }
 
-static void onyxIntegerSub(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  OnyxInteger opposite = *rhs;
-  opposite.positive = !opposite.positive;
-  onyxIntegerAdd(self, lhs, &opposite, vm);
+static void agateIntegerPrimorial(AgateVM *vm) {
+  uint32_t n;
+
+  if (!agateIntegerSlotCount(vm, 1, &n)) {
+    agateMathBigAbort(vm, "Non-negative Int below 2^32 expected.");
+    return;
+  }
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerPrimorial(result, n, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
 }
 
-static void onyxIntegerMul(OnyxInteger *self, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  onyxNaturalMul(self, lhs, rhs, vm);
-  self->positive = (lhs->positive == rhs->positive);
+static void agateIntegerIsProbablePrime(AgateVM *vm) {
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *value = agateIntegerValidate(vm, &local, 1);
+
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (agateSlotType(vm, 2) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+  } else if (agateSlotGetInt(vm, 2) < 0) {
+    agateMathBigAbort(vm, "Number of rounds must be non-negative.");
+  } else {
+    agateSlotSetBool(vm, AGATE_RETURN_SLOT, onyxIntegerIsProbablePrime(value, agateSlotGetInt(vm, 2), vm));
+  }
+
+  onyxIntegerDestroy(&local, vm);
 }
 
-static bool onyxIntegerDiv(OnyxInteger *quo, OnyxInteger *rem, const OnyxInteger *lhs, const OnyxInteger *rhs, AgateVM *vm) {
-  int cmpr = onyxIntegerCmpZero(rhs);
+static void agateIntegerNextPrime(AgateVM *vm) {
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *value = agateIntegerValidate(vm, &local, 1);
 
-  if (cmpr == 0) {
-    return false;
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+    onyxIntegerNextPrime(result, value, vm);
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
   }
 
-  if (cmpr < 0) {
-    OnyxInteger minus_rhs = *rhs;
-    minus_rhs.positive = !minus_rhs.positive;
-    bool status = onyxIntegerDiv(quo, rem, lhs, &minus_rhs, vm);
-    quo->positive = !quo->positive;
-    return status;
+  onyxIntegerDestroy(&local, vm);
+}
+
+static void agateIntegerSeededRandomBits(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT || agateSlotType(vm, 2) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
   }
 
-  int cmpl = onyxIntegerCmpZero(lhs);
+  if (agateSlotGetInt(vm, 2) < 0) {
+    agateMathBigAbort(vm, "Number of bits must be non-negative.");
+    return;
+  }
 
-  if (cmpl < 0) {
-    OnyxInteger minus_lhs = *lhs;
-    minus_lhs.positive = !minus_lhs.positive;
-    bool status = onyxIntegerDiv(quo, rem, &minus_lhs, rhs, vm);
+  OnyxRandom random;
+  onyxRandomCreate(&random, (uint64_t) agateSlotGetInt(vm, 1));
 
-    int cmp = onyxIntegerCmpZero(rem);
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerRandomBits(result, agateSlotGetInt(vm, 2), &random, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
 
-    quo->positive = !quo->positive;
+static void agateIntegerSeededRandomBelow(AgateVM *vm) {
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+  OnyxInteger *bound = agateIntegerValidate(vm, &local, 2);
+
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+  } else if (bound == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(bound) <= 0) {
+    agateMathBigAbort(vm, "Bound must be positive.");
+  } else {
+    OnyxRandom random;
+    onyxRandomCreate(&random, (uint64_t) agateSlotGetInt(vm, 1));
 
-    if (cmp != 0) {
-      uint32_t digit = 1;
-      OnyxInteger one;
-      one.digits = &digit;
-      one.size = one.capacity = 1;
-      one.positive = true;
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+    onyxIntegerRandomBelow(result, bound, &random, vm);
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
 
-      onyxIntegerSub(quo, quo, &one, vm);
-      onyxIntegerSub(rem, rhs, rem, vm);
-    }
+  onyxIntegerDestroy(&local, vm);
+}
 
-    return status;
+static void agateIntegerQuoRem(AgateVM *vm) {
+  OnyxInteger local_lhs;
+  onyxIntegerCreateEmpty(&local_lhs);
+  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
+
+  OnyxInteger local_rhs;
+  onyxIntegerCreateEmpty(&local_rhs);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+
+  ptrdiff_t quo_slot = agateSlotAllocate(vm);
+  OnyxInteger *quo = agateIntegerSlotNew(vm, quo_slot);
+
+  ptrdiff_t rem_slot = agateSlotAllocate(vm);
+  OnyxInteger *rem = agateIntegerSlotNew(vm, rem_slot);
+
+  onyxIntegerDiv(quo, rem, lhs, rhs, vm);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  agateSlotArrayNew(vm, result_slot);
+  agateSlotArrayInsert(vm, result_slot, 0, quo_slot);
+  agateSlotArrayInsert(vm, result_slot, 1, rem_slot);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+
+  onyxIntegerDestroy(&local_lhs, vm);
+  onyxIntegerDestroy(&local_rhs, vm);
+}
+
+#define AGATE_LN2 0.69314718055995
+
+static void agateIntegerToS(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  int64_t base = agateSlotGetInt(vm, 1);
+
+  if (base < 2 || base > 36) {
+    // TODO: error
   }
 
-  assert(cmpr > 0);
-  assert(cmpl >= 0);
+  // + 1 for the most significant character, + 1 for rounding errors, + 1 for '-'
+  ptrdiff_t capacity = floor(integer->size * ONYX_DIGIT_BITS * AGATE_LN2 / log(base)) + 3;
+  const ptrdiff_t buffer_size = (capacity + sizeof(OnyxDigit) - 1) / sizeof(OnyxDigit);
+  OnyxDigit *buffer = onyxScratchAllocate(vm, buffer_size);
+  char *str = (char *) buffer;
 
-  onyxNaturalDiv(quo, rem, lhs, rhs, vm);
-  quo->positive = true;
-  rem->positive = true;
-  return true;
+  OnyxRadix radix;
+  onyxRadixCreate(&radix, base);
+  onyxNaturalToChars(integer, str + 1, capacity - 1, &radix, vm);
+  onyxRadixDestroy(&radix, vm);
+
+  ptrdiff_t start = 1;
+
+  while (start < capacity - 1 && str[start] == '0') {
+    ++start;
+  }
+
+  if (onyxIntegerCmpZero(integer) < 0) {
+    str[--start] = '-';
+  }
+
+  agateSlotSetStringSize(vm, 0, str + start, capacity - start);
+
+  onyxScratchRelease(vm, buffer, buffer_size);
 }
 
-static void onyxIntegerFromInt(OnyxInteger *self, int64_t val, AgateVM *vm) {
-  onyxNaturalEnsureCapacity(self, 2, vm);
-  self->size = 2;
+// checks if the slot is the name of a byte order
+static bool agateIntegerSlotEndian(AgateVM *vm, ptrdiff_t slot, bool *big_endian) {
+  if (agateSlotType(vm, slot) != AGATE_TYPE_STRING) {
+    return false;
+  }
 
-  if (val < 0) {
-    self->positive = false;
+  const char *endian = agateSlotGetString(vm, slot);
 
-    // special case for INT64_MIN because -INT64_MIN is UB
-    if (val == INT64_MIN) {
-      self->digits[0] = UINT32_C(0xFFFFFFFF);
-      self->digits[1] = UINT32_C(0x7FFFFFFF);
-      return;
-    }
+  if (strcmp(endian, "little") == 0) {
+    *big_endian = false;
+    return true;
+  }
 
-    val = -val;
-  } else {
-    self->positive = true;
+  if (strcmp(endian, "big") == 0) {
+    *big_endian = true;
+    return true;
   }
 
-  self->digits[0] = (uint64_t) val % BASE;
-  self->digits[1] = (uint64_t) val / BASE;
-  onyxNaturalNormalize(self);
+  return false;
 }
 
-static uint32_t onyxDigit(char c) {
-  if ('0' <= c && c <= '9') {
-    return c - '0';
+static void agateIntegerFromBytes(AgateVM *vm) {
+  bool big_endian;
+
+  if (agateSlotType(vm, 1) != AGATE_TYPE_STRING) {
+    agateMathBigAbort(vm, "String expected.");
+    return;
   }
 
-  if ('A' <= c && c <= 'Z') {
-    return c - 'A' + 10;
+  if (!agateIntegerSlotEndian(vm, 2, &big_endian)) {
+    agateMathBigAbort(vm, "Byte order must be \"little\" or \"big\".");
+    return;
   }
 
-  if ('a' <= c && c <= 'z') {
-    return c - 'a' + 10;
+  if (agateSlotType(vm, 3) != AGATE_TYPE_BOOL) {
+    agateMathBigAbort(vm, "Bool expected.");
+    return;
   }
 
-  return UINT32_MAX;
+  ptrdiff_t size;
+  const char *bytes = agateSlotGetStringSize(vm, 1, &size);
+  bool twos_complement = agateSlotGetBool(vm, 3);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerFromBytes(result, (const uint8_t *) bytes, size, big_endian, twos_complement, vm);
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
 }
 
-static bool onyxIntegerFromString(OnyxInteger *self, const char *str, uint32_t base, AgateVM *vm) {
-  if (str[0] == '-') {
-    self->positive = false;
-    ++str;
-  } else {
-    self->positive = true;
+static void agateIntegerToBytes(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
+  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+
+  bool big_endian;
+
+  if (!agateIntegerSlotEndian(vm, 1, &big_endian)) {
+    agateMathBigAbort(vm, "Byte order must be \"little\" or \"big\".");
+    return;
   }
 
-  onyxNaturalEnsureCapacity(self, 2, vm);
-  self->size = 1;
-  self->digits[0] = UINT32_C(0);
+  if (agateSlotType(vm, 2) != AGATE_TYPE_BOOL) {
+    agateMathBigAbort(vm, "Bool expected.");
+    return;
+  }
 
-  while (*str != '\0') {
-    uint32_t digit = onyxDigit(*str);
+  bool twos_complement = agateSlotGetBool(vm, 2);
 
-    if (digit >= base) {
-      return false;
+  if (!twos_complement && onyxIntegerCmpZero(integer) < 0) {
+    agateMathBigAbort(vm, "Negative Integer needs two's complement.");
+    return;
+  }
+
+  ptrdiff_t size = onyxIntegerBytesSize(integer, twos_complement);
+  const ptrdiff_t buffer_size = (size + sizeof(OnyxDigit) - 1) / sizeof(OnyxDigit);
+  OnyxDigit *buffer = onyxScratchAllocate(vm, buffer_size);
+  uint8_t *bytes = (uint8_t *) buffer;
+
+  onyxIntegerToBytes(integer, bytes, size, big_endian);
+  agateSlotSetStringSize(vm, AGATE_RETURN_SLOT, (const char *) bytes, size);
+
+  onyxScratchRelease(vm, buffer, buffer_size);
+}
+
+static void agateIntegerPack(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_ARRAY) {
+    agateMathBigAbort(vm, "Array expected.");
+    return;
+  }
+
+  ptrdiff_t count = agateSlotArraySize(vm, 1);
+  ptrdiff_t element_slot = agateSlotAllocate(vm);
+
+  uint8_t *bytes = NULL;
+  ptrdiff_t size = 0;
+  ptrdiff_t capacity = 0;
+
+  OnyxInteger local;
+  onyxIntegerCreateEmpty(&local);
+
+  bool valid = true;
+
+  for (ptrdiff_t i = 0; i < count; ++i) {
+    agateSlotArrayGet(vm, 1, i, element_slot);
+    OnyxInteger *value = agateIntegerValidate(vm, &local, element_slot);
+
+    if (value == NULL) {
+      valid = false;
+      break;
     }
 
-    onyxNaturalMulShort(self, self, base, vm);
-    onyxNaturalAddShort(self, self, digit, vm);
+    ptrdiff_t needed = size + onyxIntegerPackedSize(value);
 
-    ++str;
+    if (needed > capacity) {
+      capacity = onyxSizeMax(needed, 2 * capacity);
+      bytes = agateMemoryAllocate(vm, bytes, capacity);
+    }
+
+    size += onyxIntegerPack(value, bytes + size);
   }
 
-  return true;
+  if (valid) {
+    agateSlotSetStringSize(vm, AGATE_RETURN_SLOT, (const char *) bytes, size);
+  } else {
+    agateMathBigAbort(vm, "Array of integers expected.");
+  }
+
+  if (bytes != NULL) {
+    agateMemoryAllocate(vm, bytes, 0);
+  }
+
+  onyxIntegerDestroy(&local, vm);
 }
 
-/*
- * API implementation
- */
+static void agateIntegerUnpack(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_STRING) {
+    agateMathBigAbort(vm, "String expected.");
+    return;
+  }
 
-static OnyxInteger *agateIntegerValidate(AgateVM *vm, OnyxInteger *integer, ptrdiff_t slot) {
-  if (agateSlotType(vm, slot) == AGATE_TYPE_INT) {
-    int64_t val = agateSlotGetInt(vm, slot);
-    onyxIntegerFromInt(integer, val, vm);
-    return integer;
+  ptrdiff_t size;
+  const uint8_t *bytes = (const uint8_t *) agateSlotGetStringSize(vm, 1, &size);
+
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  agateSlotArrayNew(vm, result_slot);
+
+  ptrdiff_t element_slot = agateSlotAllocate(vm);
+  ptrdiff_t count = 0;
+
+  while (size > 0) {
+    OnyxInteger *element = agateIntegerSlotNew(vm, element_slot);
+    ptrdiff_t read = onyxIntegerUnpack(element, bytes, size, vm);
+
+    if (read == 0) {
+      agateMathBigAbort(vm, "Malformed packed integers.");
+      return;
+    }
+
+    agateSlotArrayInsert(vm, result_slot, count++, element_slot);
+    bytes += read;
+    size -= read;
+  }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
+
+// workers
+
+static void agateIntegerWorkers(AgateVM *vm) {
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, atomic_load(&onyxWorkersCount));
+}
+
+static void agateIntegerSetWorkers(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
   }
 
-  if (agateSlotType(vm, slot) == AGATE_TYPE_STRING) {
-    const char *str = agateSlotGetString(vm, slot);
+  if (agateSlotGetInt(vm, 1) < 0) {
+    agateMathBigAbort(vm, "Number of workers must be non-negative.");
+    return;
+  }
 
-    if (!onyxIntegerFromString(integer, str, 10, vm)) {
-      // TODO: error
-      return NULL;
-    }
+  int64_t count = agateSlotGetInt(vm, 1);
+  onyxWorkersSetCount(count < ONYX_WORKERS_MAX ? count : ONYX_WORKERS_MAX);
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, atomic_load(&onyxWorkersCount));
+}
 
-    return integer;
+static void agateIntegerWorkersThreshold(AgateVM *vm) {
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, atomic_load(&onyxWorkersThreshold));
+}
+
+static void agateIntegerSetWorkersThreshold(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_INT) {
+    agateMathBigAbort(vm, "Int expected.");
+    return;
   }
 
-  if (agateSlotType(vm, slot) == AGATE_TYPE_FOREIGN && agateSlotGetForeignTag(vm, slot) == AGATE_MATH_BIG_INTEGER_TAG) {
-    return agateSlotGetForeign(vm, slot);
+  if (agateSlotGetInt(vm, 1) < 1) {
+    agateMathBigAbort(vm, "Workers threshold must be positive.");
+    return;
   }
 
-  // TODO: error
-  return NULL;
+  int64_t threshold = agateSlotGetInt(vm, 1);
+  onyxWorkersSetThreshold(threshold < PTRDIFF_MAX ? threshold : PTRDIFF_MAX);
+  agateSlotSetInt(vm, AGATE_RETURN_SLOT, threshold);
 }
 
-// class
-
-static ptrdiff_t agateIntegerAllocate(AgateVM *vm, const char *unit_name, const char *class_name) {
-  return sizeof(OnyxInteger);
+static void agateIntegerStatsEnabled(AgateVM *vm) {
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, onyxStatsActive());
 }
 
-static uint64_t agateIntegerTag(AgateVM *vm, const char *unit_name, const char *class_name) {
-  return AGATE_MATH_BIG_INTEGER_TAG;
+static void agateIntegerSetStatsEnabled(AgateVM *vm) {
+  if (agateSlotType(vm, 1) != AGATE_TYPE_BOOL) {
+    agateMathBigAbort(vm, "Bool expected.");
+    return;
+  }
+
+  onyxStatsSetEnabled(agateSlotGetBool(vm, 1));
+  agateSlotSetBool(vm, AGATE_RETURN_SLOT, onyxStatsActive());
 }
 
-void agateIntegerDestroy(AgateVM *vm, const char *unit_name, const char *class_name, void *data) {
-  OnyxInteger *integer = data;
-  onyxIntegerDestroy(integer, vm);
+static void agateIntegerResetStats(AgateVM *vm) {
+  onyxStatsReset();
+  agateSlotSetNil(vm, AGATE_RETURN_SLOT);
 }
 
-// methods
+#if ONYX_STATS
+// map[key] = value
+static void agateStatsMapSet(AgateVM *vm, ptrdiff_t map_slot, const char *key, ptrdiff_t value_slot) {
+  ptrdiff_t key_slot = agateSlotAllocate(vm);
+  agateSlotSetString(vm, key_slot, key);
+  agateSlotMapSet(vm, map_slot, key_slot, value_slot);
+}
 
-static void agateIntegerNew0(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-  onyxIntegerCreateEmpty(integer);
-  onyxIntegerFromInt(integer, 0, vm);
+static void agateStatsMapSetCounter(AgateVM *vm, ptrdiff_t map_slot, const char *key, atomic_uint_least64_t *counter) {
+  uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+  ptrdiff_t value_slot = agateSlotAllocate(vm);
+  agateSlotSetInt(vm, value_slot, value < INT64_MAX ? (int64_t) value : INT64_MAX);
+  agateStatsMapSet(vm, map_slot, key, value_slot);
 }
+#endif
 
-static void agateIntegerNew1(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-  onyxIntegerCreateEmpty(integer);
+static void agateIntegerStats(AgateVM *vm) {
+#if ONYX_STATS
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  agateSlotMapNew(vm, result_slot);
 
-  OnyxInteger *result = agateIntegerValidate(vm, integer, 1);
+  ptrdiff_t digit_bits_slot = agateSlotAllocate(vm);
+  agateSlotSetInt(vm, digit_bits_slot, ONYX_DIGIT_BITS);
+  agateStatsMapSet(vm, result_slot, "digit_bits", digit_bits_slot);
 
-  if (result != NULL && result != integer) {
-    onyxIntegerCopy(integer, result, vm);
+  // operations: name -> { calls, nanoseconds, sizes }, sizes[i] counts the largest operands of [2^i, 2^(i+1)) digits
+  ptrdiff_t operations_slot = agateSlotAllocate(vm);
+  agateSlotMapNew(vm, operations_slot);
+  ptrdiff_t operation_slot = agateSlotAllocate(vm);
+  ptrdiff_t sizes_slot = agateSlotAllocate(vm);
+  ptrdiff_t size_slot = agateSlotAllocate(vm);
+
+  for (ptrdiff_t i = 0; i < ONYX_STATS_OPERATION_COUNT; ++i) {
+    OnyxStatsCounters *counters = &onyxStats.operations[i];
+    agateSlotMapNew(vm, operation_slot);
+    agateStatsMapSetCounter(vm, operation_slot, "calls", &counters->calls);
+    agateStatsMapSetCounter(vm, operation_slot, "nanoseconds", &counters->nanoseconds);
+
+    ptrdiff_t count = ONYX_STATS_SIZES;
+
+    while (count > 0 && atomic_load_explicit(&counters->sizes[count - 1], memory_order_relaxed) == 0) {
+      --count;
+    }
+
+    agateSlotArrayNew(vm, sizes_slot);
+
+    for (ptrdiff_t j = 0; j < count; ++j) {
+      agateSlotSetInt(vm, size_slot, (int64_t) atomic_load_explicit(&counters->sizes[j], memory_order_relaxed));
+      agateSlotArrayInsert(vm, sizes_slot, j, size_slot);
+    }
+
+    agateStatsMapSet(vm, operation_slot, "sizes", sizes_slot);
+    agateStatsMapSet(vm, operations_slot, onyxStatsOperationNames[i], operation_slot);
   }
-}
 
-static void agateIntegerNew2(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-  onyxIntegerCreateEmpty(integer);
+  agateStatsMapSet(vm, result_slot, "operations", operations_slot);
 
-  const char *str = agateSlotGetString(vm, 1);
-  int64_t base = agateSlotGetInt(vm, 2);
+  // tiers: name -> number of dispatches, including the recursive ones
+  ptrdiff_t tiers_slot = agateSlotAllocate(vm);
+  agateSlotMapNew(vm, tiers_slot);
 
-  if (base <= 0 || base > 36) {
-    // TODO: error
+  for (ptrdiff_t i = 0; i < ONYX_STATS_TIER_COUNT; ++i) {
+    agateStatsMapSetCounter(vm, tiers_slot, onyxStatsTierNames[i], &onyxStats.tiers[i]);
   }
 
-  if (!onyxIntegerFromString(integer, str, base, vm)) {
-      // TODO: error
+  agateStatsMapSet(vm, result_slot, "tiers", tiers_slot);
+
+  for (ptrdiff_t i = 0; i < ONYX_STATS_MEMORY_COUNT; ++i) {
+    agateStatsMapSetCounter(vm, result_slot, onyxStatsMemoryNames[i], &onyxStats.memory[i]);
   }
+
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+#else
+  agateSlotSetNil(vm, AGATE_RETURN_SLOT);
+#endif
 }
 
-static void agateIntegerPositive(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-  agateSlotSetBool(vm, AGATE_RETURN_SLOT, integer->positive);
+/*
+ * Modulus
+ */
+
+// class
+
+static ptrdiff_t agateModulusAllocate(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return sizeof(OnyxModulus);
 }
 
-static void agateIntegerIsZero(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-  agateSlotSetBool(vm, AGATE_RETURN_SLOT, integer->size == 1 && integer->digits[0] == UINT32_C(0));
+static uint64_t agateModulusTag(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return AGATE_MATH_BIG_MODULUS_TAG;
 }
 
-static void agateIntegerCmp(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+static void agateModulusDestroy(AgateVM *vm, const char *unit_name, const char *class_name, void *data) {
+  OnyxModulus *modulus = data;
+
+  if (modulus->modulus.size > 0) {
+    onyxModulusDestroy(modulus, vm);
+  }
+}
+
+// methods
+
+static void agateModulusNew(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_MODULUS_TAG);
+  OnyxModulus *modulus = agateSlotGetForeign(vm, 0);
+  onyxIntegerCreateEmpty(&modulus->modulus);
 
   OnyxInteger local;
   onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+  OnyxInteger *value = agateIntegerValidate(vm, &local, 1);
 
-  int cmp = onyxIntegerCmp(lhs, rhs);
-  agateSlotSetInt(vm, AGATE_RETURN_SLOT, cmp);
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(value) <= 0) {
+    agateMathBigAbort(vm, "Modulus must be positive.");
+  } else {
+    onyxModulusCreate(modulus, value, vm);
+  }
 
   onyxIntegerDestroy(&local, vm);
 }
 
-static void agateIntegerPlus(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
-
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+static void agateModulusValue(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_MODULUS_TAG);
+  OnyxModulus *modulus = agateSlotGetForeign(vm, 0);
 
   ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
-  onyxIntegerCopy(result, integer, vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerCopy(result, &modulus->modulus, vm);
+
   agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
 }
 
-static void agateIntegerMinus(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+static void agateModulusModMul(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_MODULUS_TAG);
+  OnyxModulus *modulus = agateSlotGetForeign(vm, 0);
 
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+  OnyxInteger local_lhs;
+  onyxIntegerCreateEmpty(&local_lhs);
+  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
 
-  ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
-  onyxIntegerCopy(result, integer, vm);
-  result->positive = !result->positive;
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  OnyxInteger local_rhs;
+  onyxIntegerCreateEmpty(&local_rhs);
+  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+
+  // the constructor aborted if the modulus was not valid
+  assert(modulus->modulus.size > 0);
+
+  if (lhs == NULL || rhs == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+    onyxModulusMulInteger(modulus, result, lhs, rhs, vm);
+
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
+
+  onyxIntegerDestroy(&local_lhs, vm);
+  onyxIntegerDestroy(&local_rhs, vm);
 }
 
-static void agateIntegerAdd(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+static void agateModulusModPow(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_MODULUS_TAG);
+  OnyxModulus *modulus = agateSlotGetForeign(vm, 0);
 
-  OnyxInteger local;
-  onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+  OnyxInteger local_base;
+  onyxIntegerCreateEmpty(&local_base);
+  OnyxInteger *base = agateIntegerValidate(vm, &local_base, 1);
 
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+  OnyxInteger local_exponent;
+  onyxIntegerCreateEmpty(&local_exponent);
+  OnyxInteger *exponent = agateIntegerValidate(vm, &local_exponent, 2);
 
-  ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
+  assert(modulus->modulus.size > 0);
 
-  onyxIntegerAdd(result, lhs, rhs, vm);
+  if (base == NULL || exponent == NULL) {
+    agateMathBigAbort(vm, "Integer expected.");
+  } else if (onyxIntegerCmpZero(exponent) < 0) {
+    agateMathBigAbort(vm, "Exponent must be non-negative.");
+  } else {
+    ptrdiff_t result_slot = agateSlotAllocate(vm);
+    OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+    onyxModulusPowInteger(modulus, result, base, exponent, vm);
 
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  }
 
-  onyxIntegerDestroy(&local, vm);
+  onyxIntegerDestroy(&local_base, vm);
+  onyxIntegerDestroy(&local_exponent, vm);
 }
 
-static void agateIntegerSub(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+/*
+ * Rational
+ */
 
-  OnyxInteger local;
-  onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+// creates a new Rational in the slot
+static OnyxRational *agateRationalSlotNew(AgateVM *vm, ptrdiff_t slot) {
+  AgateMathBigState *state = agateMathBigStateAcquire(vm);
 
   ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+  agateSlotSetHandle(vm, class_slot, state->rational_class);
 
-  ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
+  OnyxRational *rational = agateSlotSetForeign(vm, slot, class_slot);
+  onyxRationalCreate(rational, vm);
+  return rational;
+}
 
-  onyxIntegerSub(result, lhs, rhs, vm);
+// accepts a Rational, or anything accepted by agateIntegerValidate
+static OnyxRational *agateRationalValidate(AgateVM *vm, OnyxRational *rational, ptrdiff_t slot) {
+  if (agateSlotType(vm, slot) == AGATE_TYPE_FOREIGN && agateSlotGetForeignTag(vm, slot) == AGATE_MATH_BIG_RATIONAL_TAG) {
+    OnyxRational *result = agateSlotGetForeign(vm, slot);
+    assert(result->den.size > 0);
+    return result;
+  }
 
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  OnyxInteger *integer = agateIntegerValidate(vm, &rational->num, slot);
 
-  onyxIntegerDestroy(&local, vm);
+  if (integer == NULL) {
+    return NULL;
+  }
+
+  if (integer != &rational->num) {
+    onyxIntegerCopy(&rational->num, integer, vm);
+  }
+
+  onyxIntegerFromInt(&rational->den, 1, vm);
+  rational->base_size = onyxRationalSize(rational);
+  rational->reduced = true;
+  return rational;
 }
 
-static void agateIntegerMul(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+// class
 
-  OnyxInteger local;
-  onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+static ptrdiff_t agateRationalAllocate(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return sizeof(OnyxRational);
+}
 
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+static uint64_t agateRationalTag(AgateVM *vm, const char *unit_name, const char *class_name) {
+  return AGATE_MATH_BIG_RATIONAL_TAG;
+}
 
-  ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
+static void agateRationalDestroy(AgateVM *vm, const char *unit_name, const char *class_name, void *data) {
+  OnyxRational *rational = data;
+  onyxRationalDestroy(rational, vm);
+  agateMathBigStateRelease(vm);
+}
 
-  onyxIntegerMul(result, lhs, rhs, vm);
+// methods
 
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+static void agateRationalNew1(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
+  onyxRationalCreate(rational, vm);
+  agateMathBigStateAcquire(vm);
 
-  onyxIntegerDestroy(&local, vm);
-}
+  OnyxRational local;
+  onyxRationalCreate(&local, vm);
+  OnyxRational *value = agateRationalValidate(vm, &local, 1);
 
-static void agateIntegerDiv(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
+  if (value == NULL) {
+    agateMathBigAbort(vm, "Rational or Integer expected.");
+  } else {
+    onyxIntegerCopy(&rational->num, &value->num, vm);
+    onyxNaturalCopy(&rational->den, &value->den, vm);
+    rational->base_size = value->base_size;
+    rational->reduced = value->reduced;
+  }
 
-  OnyxInteger local;
-  onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+  onyxRationalDestroy(&local, vm);
+}
 
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+static void agateRationalNew2(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
+  onyxRationalCreate(rational, vm);
+  agateMathBigStateAcquire(vm);
 
-  ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
+  OnyxRational local_num;
+  onyxRationalCreate(&local_num, vm);
+  OnyxRational *num = agateRationalValidate(vm, &local_num, 1);
 
-  OnyxInteger discarded;
-  onyxIntegerCreateEmpty(&discarded);
+  OnyxRational local_den;
+  onyxRationalCreate(&local_den, vm);
+  OnyxRational *den = agateRationalValidate(vm, &local_den, 2);
 
-  onyxIntegerDiv(result, &discarded, lhs, rhs, vm);
+  if (num == NULL || den == NULL) {
+    agateMathBigAbort(vm, "Rational or Integer expected.");
+  } else if (!onyxRationalMul(rational, num, den, true, vm)) {
+    agateMathBigAbort(vm, "Division by zero.");
+  } else {
+    onyxRationalReduce(rational, vm);
+  }
 
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
-  onyxIntegerDestroy(&discarded, vm);
-  onyxIntegerDestroy(&local, vm);
+  onyxRationalDestroy(&local_num, vm);
+  onyxRationalDestroy(&local_den, vm);
 }
 
-static void agateIntegerMod(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *lhs = agateSlotGetForeign(vm, 0);
-
-  OnyxInteger local;
-  onyxIntegerCreateEmpty(&local);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local, 1);
+static void agateRationalNum(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
 
-  ptrdiff_t class_slot = agateSlotAllocate(vm);
-  agateGetVariable(vm, "math/big", "Integer", class_slot);
+  onyxRationalReduce(rational, vm);
 
   ptrdiff_t result_slot = agateSlotAllocate(vm);
-  OnyxInteger *result = agateSlotSetForeign(vm, result_slot, class_slot);
-  onyxIntegerCreateEmpty(result);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerCopy(result, &rational->num, vm);
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
 
-  OnyxInteger discarded;
-  onyxIntegerCreateEmpty(&discarded);
+static void agateRationalDen(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
 
-  onyxIntegerDiv(&discarded, result, lhs, rhs, vm);
+  onyxRationalReduce(rational, vm);
 
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxInteger *result = agateIntegerSlotNew(vm, result_slot);
+  onyxIntegerCopy(result, &rational->den, vm);
   agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
-  onyxIntegerDestroy(&discarded, vm);
-  onyxIntegerDestroy(&local, vm);
 }
 
-static void agateIntegerQuoRem(AgateVM *vm) {
-  OnyxInteger local_lhs;
-  onyxIntegerCreateEmpty(&local_lhs);
-  OnyxInteger *lhs = agateIntegerValidate(vm, &local_lhs, 1);
+static void agateRationalMinus(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
 
-  OnyxInteger local_rhs;
-  onyxIntegerCreateEmpty(&local_rhs);
-  OnyxInteger *rhs = agateIntegerValidate(vm, &local_rhs, 2);
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxRational *result = agateRationalSlotNew(vm, result_slot);
+  onyxIntegerCopy(&result->num, &rational->num, vm);
+  onyxNaturalCopy(&result->den, &rational->den, vm);
+  result->num.positive = !result->num.positive || onyxNaturalCmpZero(&result->num) == 0;
+  result->base_size = rational->base_size;
+  result->reduced = rational->reduced;
+  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+}
 
-  ptrdiff_t quo_slot = agateSlotAllocate(vm);
-  OnyxInteger *quo = agateSlotSetForeign(vm, quo_slot, 0);
-  onyxIntegerCreateEmpty(quo);
+typedef enum {
+  AGATE_RATIONAL_ADD,
+  AGATE_RATIONAL_SUB,
+  AGATE_RATIONAL_MUL,
+  AGATE_RATIONAL_DIV,
+} AgateRationalOperation;
 
-  ptrdiff_t rem_slot = agateSlotAllocate(vm);
-  OnyxInteger *rem = agateSlotSetForeign(vm, rem_slot, 0);
-  onyxIntegerCreateEmpty(rem);
+static void agateRationalArithmetic(AgateVM *vm, AgateRationalOperation op) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *lhs = agateSlotGetForeign(vm, 0);
 
-  onyxIntegerDiv(quo, rem, lhs, rhs, vm);
+  OnyxRational local;
+  onyxRationalCreate(&local, vm);
+  OnyxRational *rhs = agateRationalValidate(vm, &local, 1);
+
+  if (rhs == NULL) {
+    agateMathBigAbort(vm, "Rational or Integer expected.");
+    onyxRationalDestroy(&local, vm);
+    return;
+  }
 
   ptrdiff_t result_slot = agateSlotAllocate(vm);
-  agateSlotArrayNew(vm, result_slot);
-  agateSlotArrayInsert(vm, result_slot, 0, quo_slot);
-  agateSlotArrayInsert(vm, result_slot, 1, rem_slot);
+  OnyxRational *result = agateRationalSlotNew(vm, result_slot);
+  bool status = true;
+
+  switch (op) {
+    case AGATE_RATIONAL_ADD:
+      onyxRationalAdd(result, lhs, rhs, false, vm);
+      break;
+    case AGATE_RATIONAL_SUB:
+      onyxRationalAdd(result, lhs, rhs, true, vm);
+      break;
+    case AGATE_RATIONAL_MUL:
+      status = onyxRationalMul(result, lhs, rhs, false, vm);
+      break;
+    case AGATE_RATIONAL_DIV:
+      status = onyxRationalMul(result, lhs, rhs, true, vm);
+      break;
+  }
 
-  agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  if (status) {
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  } else {
+    agateMathBigAbort(vm, "Division by zero.");
+  }
 
-  onyxIntegerDestroy(&local_lhs, vm);
-  onyxIntegerDestroy(&local_rhs, vm);
+  onyxRationalDestroy(&local, vm);
 }
 
-#define AGATE_LN2 0.69314718055995
+static void agateRationalAdd(AgateVM *vm) {
+  agateRationalArithmetic(vm, AGATE_RATIONAL_ADD);
+}
 
-static void agateIntegerToS(AgateVM *vm) {
-  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_INTEGER_TAG);
-  OnyxInteger *integer = agateSlotGetForeign(vm, 0);
+static void agateRationalSub(AgateVM *vm) {
+  agateRationalArithmetic(vm, AGATE_RATIONAL_SUB);
+}
 
-  int64_t base = agateSlotGetInt(vm, 1);
+static void agateRationalMul(AgateVM *vm) {
+  agateRationalArithmetic(vm, AGATE_RATIONAL_MUL);
+}
 
-  if (base <= 0 || base > 36) {
-    // TODO: error
-  }
+static void agateRationalDiv(AgateVM *vm) {
+  agateRationalArithmetic(vm, AGATE_RATIONAL_DIV);
+}
 
-  static const char *digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-  ptrdiff_t capacity = floor(integer->size * 32 * log(base) / AGATE_LN2) + 1; // + 1 for '-'
-  char *str = agateMemoryAllocate(vm, NULL, capacity);
-  ptrdiff_t size = 0;
+static void agateRationalInverse(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
 
-  OnyxInteger copy;
-  onyxIntegerCreateEmpty(&copy);
-  onyxIntegerCopy(&copy, integer, vm);
+  OnyxRational one;
+  onyxRationalCreate(&one, vm);
+  onyxIntegerFromInt(&one.num, 1, vm);
 
-  while (onyxNaturalCmpZero(&copy) > 0) {
-    uint32_t rem;
-    onyxNaturalDivShort(&copy, &rem, &copy, base, vm);
-    assert(size < capacity);
-    assert(rem < 36);
-    str[size++] = digits[rem];
-  }
+  ptrdiff_t result_slot = agateSlotAllocate(vm);
+  OnyxRational *result = agateRationalSlotNew(vm, result_slot);
 
-  if (size == 0) {
-    assert(size < capacity);
-    str[size++] = '0';
+  if (onyxRationalMul(result, &one, rational, true, vm)) {
+    agateSlotCopy(vm, AGATE_RETURN_SLOT, result_slot);
+  } else {
+    agateMathBigAbort(vm, "Division by zero.");
   }
 
-  if (!copy.positive) {
-    assert(size < capacity);
-    str[size++] = '-';
-  }
+  onyxRationalDestroy(&one, vm);
+}
+
+static void agateRationalCmp(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *lhs = agateSlotGetForeign(vm, 0);
 
-  for (ptrdiff_t i = 0; i < size / 2; ++i) {
-    char tmp = str[i];
-    str[i] = str[size - i - 1];
-    str[size - i - 1] = tmp;
+  OnyxRational local;
+  onyxRationalCreate(&local, vm);
+  OnyxRational *rhs = agateRationalValidate(vm, &local, 1);
+
+  if (rhs == NULL) {
+    // not comparable, so that == is false and != is true
+    agateSlotSetNil(vm, AGATE_RETURN_SLOT);
+  } else {
+    agateSlotSetInt(vm, AGATE_RETURN_SLOT, onyxRationalCmp(lhs, rhs, vm));
   }
 
-  agateSlotSetStringSize(vm, 0, str, size);
+  onyxRationalDestroy(&local, vm);
+}
+
+static void agateRationalToF(AgateVM *vm) {
+  assert(agateSlotGetForeignTag(vm, 0) == AGATE_MATH_BIG_RATIONAL_TAG);
+  OnyxRational *rational = agateSlotGetForeign(vm, 0);
 
-  onyxIntegerDestroy(&copy, vm);
-  agateMemoryAllocate(vm, str, 0);
+  agateSlotSetFloat(vm, AGATE_RETURN_SLOT, onyxRationalToDouble(rational, vm));
 }
 
 /*
@@ -897,6 +7174,7 @@ static inline bool agateEquals(const char *lhs, const char *rhs) {
 
 AgateForeignClassHandler agateMathBigClassHandler(AgateVM *vm, const char *unit_name, const char *class_name) {
   assert(agateEquals(unit_name, "math/big"));
+  onyxDigitsSelectKernels();
 
   AgateForeignClassHandler handler = { NULL, NULL, NULL };
 
@@ -907,6 +7185,20 @@ AgateForeignClassHandler agateMathBigClassHandler(AgateVM *vm, const char *unit_
     return handler;
   }
 
+  if (agateEquals(class_name, "Modulus")) {
+    handler.allocate = agateModulusAllocate;
+    handler.tag = agateModulusTag;
+    handler.destroy = agateModulusDestroy;
+    return handler;
+  }
+
+  if (agateEquals(class_name, "Rational")) {
+    handler.allocate = agateRationalAllocate;
+    handler.tag = agateRationalTag;
+    handler.destroy = agateRationalDestroy;
+    return handler;
+  }
+
   return handler;
 }
 
@@ -925,12 +7217,81 @@ AgateForeignMethodFunc agateMathBigMethodHandler(AgateVM *vm, const char *unit_n
       if (agateEquals(signature, "*(_)")) { return agateIntegerMul; }
       if (agateEquals(signature, "/(_)")) { return agateIntegerDiv; }
       if (agateEquals(signature, "%(_)")) { return agateIntegerMod; }
+      if (agateEquals(signature, "<<(_)")) { return agateIntegerLeftShift; }
+      if (agateEquals(signature, ">>(_)")) { return agateIntegerRightShift; }
+      if (agateEquals(signature, "&(_)")) { return agateIntegerAnd; }
+      if (agateEquals(signature, "|(_)")) { return agateIntegerOr; }
+      if (agateEquals(signature, "^(_)")) { return agateIntegerXor; }
+      if (agateEquals(signature, "~")) { return agateIntegerNot; }
+      if (agateEquals(signature, "bit_length")) { return agateIntegerBitLength; }
+      if (agateEquals(signature, "popcount")) { return agateIntegerPopCount; }
+      if (agateEquals(signature, "test_bit(_)")) { return agateIntegerTestBit; }
+      if (agateEquals(signature, "set(_)")) { return agateIntegerSet; }
+      if (agateEquals(signature, "add_assign(_)")) { return agateIntegerAddAssign; }
+      if (agateEquals(signature, "sub_assign(_)")) { return agateIntegerSubAssign; }
+      if (agateEquals(signature, "mul_assign(_)")) { return agateIntegerMulAssign; }
+      if (agateEquals(signature, "addmul(_,_)")) { return agateIntegerAddMul; }
       if (agateEquals(signature, "cmp(_)")) { return agateIntegerCmp; }
       if (agateEquals(signature, "is_zero")) { return agateIntegerIsZero; }
       if (agateEquals(signature, "positive")) { return agateIntegerPositive; }
+      if (agateEquals(signature, "is_perfect_square")) { return agateIntegerIsPerfectSquare; }
       if (agateEquals(signature, "to_s(_)")) { return agateIntegerToS; }
+      if (agateEquals(signature, "to_bytes(_,_)")) { return agateIntegerToBytes; }
     } else if (kind == AGATE_FOREIGN_METHOD_CLASS) {
       if (agateEquals(signature, "div(_,_)")) { return agateIntegerQuoRem; }
+      if (agateEquals(signature, "exp(_,_)")) { return agateIntegerExp; }
+      if (agateEquals(signature, "gcd(_,_)")) { return agateIntegerGcd; }
+      if (agateEquals(signature, "xgcd(_,_)")) { return agateIntegerXgcd; }
+      if (agateEquals(signature, "modinv(_,_)")) { return agateIntegerModInv; }
+      if (agateEquals(signature, "isqrt(_)")) { return agateIntegerISqrt; }
+      if (agateEquals(signature, "iroot(_,_)")) { return agateIntegerIRoot; }
+      if (agateEquals(signature, "sum(_)")) { return agateIntegerSum; }
+      if (agateEquals(signature, "product(_)")) { return agateIntegerProduct; }
+      if (agateEquals(signature, "factorial(_)")) { return agateIntegerFactorial; }
+      if (agateEquals(signature, "binomial(_,_)")) { return agateIntegerBinomial; }
+      if (agateEquals(signature, "primorial(_)")) { return agateIntegerPrimorial; }
+      if (agateEquals(signature, "is_probable_prime(_,_)")) { return agateIntegerIsProbablePrime; }
+      if (agateEquals(signature, "next_prime(_)")) { return agateIntegerNextPrime; }
+      if (agateEquals(signature, "seeded_random_bits(_,_)")) { return agateIntegerSeededRandomBits; }
+      if (agateEquals(signature, "seeded_random_below(_,_)")) { return agateIntegerSeededRandomBelow; }
+      if (agateEquals(signature, "from_bytes(_,_,_)")) { return agateIntegerFromBytes; }
+      if (agateEquals(signature, "pack(_)")) { return agateIntegerPack; }
+      if (agateEquals(signature, "unpack(_)")) { return agateIntegerUnpack; }
+      if (agateEquals(signature, "workers")) { return agateIntegerWorkers; }
+      if (agateEquals(signature, "workers=(_)")) { return agateIntegerSetWorkers; }
+      if (agateEquals(signature, "workers_threshold")) { return agateIntegerWorkersThreshold; }
+      if (agateEquals(signature, "workers_threshold=(_)")) { return agateIntegerSetWorkersThreshold; }
+      if (agateEquals(signature, "stats")) { return agateIntegerStats; }
+      if (agateEquals(signature, "stats_enabled")) { return agateIntegerStatsEnabled; }
+      if (agateEquals(signature, "stats_enabled=(_)")) { return agateIntegerSetStatsEnabled; }
+      if (agateEquals(signature, "reset_stats()")) { return agateIntegerResetStats; }
+      if (agateEquals(signature, "modpow(_,_,_)")) { return agateIntegerModPow; }
+    }
+  }
+
+  if (agateEquals(class_name, "Modulus")) {
+    if (kind == AGATE_FOREIGN_METHOD_INSTANCE) {
+      if (agateEquals(signature, "init new(_)")) { return agateModulusNew; }
+      if (agateEquals(signature, "value")) { return agateModulusValue; }
+      if (agateEquals(signature, "modmul(_,_)")) { return agateModulusModMul; }
+      if (agateEquals(signature, "modpow(_,_)")) { return agateModulusModPow; }
+    }
+  }
+
+  if (agateEquals(class_name, "Rational")) {
+    if (kind == AGATE_FOREIGN_METHOD_INSTANCE) {
+      if (agateEquals(signature, "init new(_)")) { return agateRationalNew1; }
+      if (agateEquals(signature, "init new(_,_)")) { return agateRationalNew2; }
+      if (agateEquals(signature, "num")) { return agateRationalNum; }
+      if (agateEquals(signature, "den")) { return agateRationalDen; }
+      if (agateEquals(signature, "-")) { return agateRationalMinus; }
+      if (agateEquals(signature, "+(_)")) { return agateRationalAdd; }
+      if (agateEquals(signature, "-(_)")) { return agateRationalSub; }
+      if (agateEquals(signature, "*(_)")) { return agateRationalMul; }
+      if (agateEquals(signature, "/(_)")) { return agateRationalDiv; }
+      if (agateEquals(signature, "inverse")) { return agateRationalInverse; }
+      if (agateEquals(signature, "cmp(_)")) { return agateRationalCmp; }
+      if (agateEquals(signature, "to_f")) { return agateRationalToF; }
     }
   }
 
@@ -2,5 +2,7 @@
 #define AGATE_TAGS_H
 
 #define AGATE_MATH_BIG_INTEGER_TAG  0x00010001
+#define AGATE_MATH_BIG_MODULUS_TAG  0x00010002
+#define AGATE_MATH_BIG_RATIONAL_TAG 0x00010003
 
 #endif // AGATE_TAGS_H